@@ -0,0 +1,19 @@
+# Long-form normalizer benchmark: regex chain vs. phrase automaton.
+# Generates a module with N long-form declarations and times both paths
+# (the driver fails if their outputs differ).
+N=${1:-100000}
+{
+  echo "module Bench:"
+  echo "scope main range app:"
+  i=0
+  while [ $i -lt $N ]; do
+    echo "    declare explicit integer named a$i equals 0x2A plus 0x10 end   ; decl $i"
+    echo "    declare implicit named b$i equals a$i plus 0x01 end"
+    i=$((i+2))
+  done
+  echo "    return b0"
+  echo "end"
+} > bench_longform.psd
+./parashade --bench-normalize 5 < bench_longform.psd
+# Character-class scanner: scalar vs SSE2 vs AVX2 (bytes/cycle) and front-end time
+./parashade --bench-scan 5 < bench_longform.psd
@@ -0,0 +1,24 @@
+# Regression programs: src/regress/*.psd each carry "; expect: <output>" and
+# must print it at every -O level on both VMs; src/regress/*.parx are damaged
+# packets the verifier must reject.
+#   sh RegressionTest.sh [path/to/parashade] [path/to/src/regress]
+P=${1:-./parashade}
+D=${2:-../src/regress}
+fail=0
+for f in "$D"/*.psd; do
+  [ -e "$f" ] || continue
+  want=$(sed -n 's/^; expect: //p' "$f")
+  for opt in -O0 -O1 -O2; do
+    for vm in --vm=stack --vm=reg; do
+      got=$("$P" $opt $vm --run "$f" 2>&1 | tail -n 1)
+      if [ "$got" != "$want" ]; then echo "FAIL $f $opt $vm: got '$got', want '$want'"; fail=1; fi
+    done
+  done
+done
+for f in "$D"/*.parx; do
+  [ -e "$f" ] || continue
+  got=$("$P" --run "$f" 2>&1)
+  case "$got" in *verify:*) ;; *) echo "FAIL $f: not rejected: $got"; fail=1 ;; esac
+done
+[ $fail -eq 0 ] && echo "regress: all passed"
+exit $fail
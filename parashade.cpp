@@ -11,8 +11,20 @@
 //   PSD
 //
 //   ./parashade --emit <<'PSD' … PSD   (prints HEX IR + metadata)
+//   ./parashade --run a.psd b.psd       (files are memory-mapped, one module each)
+//   ./parashade --bench-normalize [reps] < file.psd   (regex chain vs phrase automaton)
 
 #include <bits/stdc++.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
 // -------- Utility
@@ -24,14 +36,112 @@ static inline string trim(string s){
 static inline bool starts_with(const string& s, const string& p){return s.rfind(p,0)==0;}
 static inline string lower(string s){ for(char& c:s) c=tolower((unsigned char)c); return s; }
 
-// -------- Long-form ➜ Core normalizer (very small demo)
-string normalize_longform(const string& in){
-    // Crude phrase mapping; extend as you grow the dialect
+// -------- Long-form ➜ Core normalizer
+// Phrase table (extend as you grow the dialect). Words match whole (\b…\b); a
+// space between words matches any in-line whitespace run; a trailing space
+// means the phrase also swallows the whitespace after it.
+enum PhraseCtx { PC_Any, PC_OpensDecl, PC_DeclOnly };
+struct Phrase { const char* pat; const char* repl; PhraseCtx ctx; };
+static const Phrase kPhraseTable[] = {
+    {"declare explicit integer named ", "let int ", PC_OpensDecl},
+    {"declare implicit named ", "let ", PC_OpensDecl},
+    {"equals", "=", PC_Any},
+    {"end", "", PC_DeclOnly}, // end of long-form decl line; core uses EOL (a block `end` is kept)
+    {"plus", "+", PC_Any},
+    {"greatest_of", "max", PC_Any},
+    {"least_of", "min", PC_Any},
+    {"module", "module", PC_Any},
+    {"scope", "scope", PC_Any},
+    {"range", "range", PC_Any},
+    {"return", "return", PC_Any},
+};
+
+static bool kWord[256], kSpace[256];
+static const bool kClassInit = []{ for(int c=0;c<256;c++){ kWord[c]=isalnum(c)||c=='_'; kSpace[c]=isspace(c)!=0; } return true; }();
+static inline bool is_word(char c){ return kWord[(unsigned char)c]; }
+static inline bool is_space(char c){ return kSpace[(unsigned char)c]; }
+
+// Word-level trie built once from kPhraseTable (no phrase is a word-prefix of another).
+struct PhraseTrie {
+    struct Node { vector<pair<string,int>> next; int rule=-1; bool eatWs=false; };
+    vector<Node> nodes{1}; vector<string> repl; vector<PhraseCtx> ctx;
+    PhraseTrie(){
+        for(auto& ph: kPhraseTable){
+            string pat=ph.pat; bool eatWs=!pat.empty() && pat.back()==' ';
+            if(eatWs) pat.pop_back();
+            int n=0; istringstream ws(pat); string w;
+            while(ws>>w){
+                int c=child(n,w.data(),w.size());
+                if(c<0){ c=(int)nodes.size(); nodes[n].next.push_back({w,c}); nodes.emplace_back(); }
+                n=c;
+            }
+            nodes[n].rule=(int)repl.size(); nodes[n].eatWs=eatWs; repl.push_back(ph.repl); ctx.push_back(ph.ctx);
+        }
+    }
+    int child(int n, const char* w, size_t len) const {
+        for(auto& e: nodes[n].next) if(e.first.size()==len && memcmp(e.first.data(),w,len)==0) return e.second;
+        return -1;
+    }
+    // phrase starting with word [w,we) inside a line ending at le -> rule index, end of match
+    int match(const char* w, const char* we, const char* le, bool atLineStart, bool& declLine, const char*& end) const {
+        int n=child(0,w,size_t(we-w));
+        while(n>=0){
+            const Node& N=nodes[n];
+            const char* s=we; while(s<le && is_space(*s)) ++s;
+            if(N.rule>=0){
+                if(N.eatWs && s==we) return -1;
+                if(ctx[N.rule]==PC_DeclOnly && !declLine) return -1;
+                if(ctx[N.rule]==PC_OpensDecl && atLineStart) declLine=true;
+                end=N.eatWs? s:we; return N.rule;
+            }
+            if(s==we || s==le || !is_word(*s)) return -1;
+            const char* t=s; while(t<le && is_word(*t)) ++t;
+            n=child(n,s,size_t(t-s)); we=t;
+        }
+        return -1;
+    }
+};
+
+// Single linear scan: strip ';' comments, rewrite phrases, trim lines.
+// Byte-identical to normalize_longform_regex.
+string normalize_longform(string_view in){
+    static const PhraseTrie trie;
+    string out; out.reserve(in.size());
+    const char* p=in.data(); const char* const E=p+in.size();
+    while(p<E){
+        const char* nl=(const char*)memchr(p,'\n',size_t(E-p)); const char* le=nl? nl:E;
+        const char* sc=(const char*)memchr(p,';',size_t(le-p));  const char* ce=sc? sc:le;
+        const size_t lineStart=out.size(); bool declLine=false;
+        auto put=[&](const char* s, size_t n){
+            if(out.size()==lineStart) while(n && is_space(*s)){ ++s; --n; }
+            out.append(s,n);
+        };
+        const char* q=p;
+        while(q<ce){
+            const char* s=q;
+            if(is_word(*q)){
+                while(q<ce && is_word(*q)) ++q;
+                const char* mEnd=nullptr; int r=trie.match(s,q,ce,out.size()==lineStart,declLine,mEnd);
+                if(r>=0){ put(trie.repl[r].data(), trie.repl[r].size()); q=mEnd; }
+                else put(s,size_t(q-s));
+            } else {
+                while(q<ce && !is_word(*q)) ++q;
+                put(s,size_t(q-s));
+            }
+        }
+        while(out.size()>lineStart && is_space(out.back())) out.pop_back();
+        out.push_back('\n');
+        p=nl? nl+1:E;
+    }
+    return out;
+}
+
+// Reference: the original per-line regex chain (used by --bench-normalize).
+string normalize_longform_regex(const string& in){
     static const vector<pair<regex,string>> map = {
         {regex("\\bdeclare\\s+explicit\\s+integer\\s+named\\s+"), "let int "},
         {regex("\\bdeclare\\s+implicit\\s+named\\s+"), "let "},
         {regex("\\bequals\\b"), "="},
-        {regex("\\bend\\b"), ""}, // end of long-form decl line; core uses EOL
         {regex("\\bplus\\b"), "+"},
         {regex("\\bgreatest_of\\b"), "max"},
         {regex("\\bleast_of\\b"), "min"},
@@ -40,21 +150,41 @@ string normalize_longform(const string& in){
         {regex("\\brange\\b"), "range"},
         {regex("\\breturn\\b"), "return"},
     };
-    // Apply line by line to preserve NASM-ish feel
+    static const regex declOpen("^\\s*declare\\s+(explicit\\s+integer|implicit)\\s+named\\s"), declEnd("\\bend\\b");
     string out; out.reserve(in.size());
     istringstream iss(in);
     string line;
     while(getline(iss,line)){
         string L = line;
-        // NASM comments start with ';'
         auto sc = L.find(';'); if(sc!=string::npos) L = L.substr(0, sc);
-        // run mappings
+        bool decl = regex_search(L, declOpen);
         for(auto& m: map) L = regex_replace(L, m.first, m.second);
+        if(decl) L = regex_replace(L, declEnd, "");
         out += trim(L) + "\n";
     }
     return out;
 }
 
+int bench_normalize(const string& src, int reps){
+    if(normalize_longform(src)!=normalize_longform_regex(src)){
+        cerr<<"bench: phrase automaton output differs from regex chain\n"; return 3;
+    }
+    auto time_it=[&](auto fn){
+        auto t0=chrono::steady_clock::now(); size_t bytes=0;
+        for(int i=0;i<reps;i++) bytes+=fn(src).size();
+        return make_pair(chrono::duration<double>(chrono::steady_clock::now()-t0).count(), bytes);
+    };
+    auto r=time_it([](const string& x){ return normalize_longform_regex(x); });
+    auto a=time_it([](const string& x){ return normalize_longform(x); });
+    double mb=double(src.size())*reps/1e6;
+    cout<<fixed<<setprecision(2)
+        <<"normalize: "<<src.size()<<" bytes x "<<reps<<" reps (outputs identical)\n"
+        <<"  regex chain     : "<<r.first*1e3<<" ms  "<<mb/r.first<<" MB/s\n"
+        <<"  phrase automaton: "<<a.first*1e3<<" ms  "<<mb/a.first<<" MB/s\n"
+        <<"  speedup         : "<<r.first/a.first<<"x\n";
+    return 0;
+}
+
 // -------- Lexer (NASM-ish, whitespace separated, ':' labels, ';' comments)
 enum class Tok { End, Ident, Number, Colon, Equals, Plus, KwModule, KwScope, KwRange, KwLet, KwInt, KwReturn, KwEnd };
 struct Token { Tok t; string s; int line; };
@@ -279,8 +409,9 @@ struct VM {
         }
     }
     // frame-by-frame interpreter (budgeted steps)
+    size_t frameIp=0; // frame progress persists across run_frame calls
     bool run_frame(int maxSteps, int64_t& last){
-        static size_t ip=0; // demo: static to simulate persistent frame progress
+        size_t& ip=frameIp;
         int steps=0;
         while(steps<maxSteps && ip<b.size()){
             switch(b[ip++]){
@@ -305,15 +436,44 @@ string meta_json(const Module& m, const Typer& T){
     s+="]}]}"; return s;
 }
 
-// -------- Driver
-int main(int argc, char** argv){
-    ios::sync_with_stdio(false);
-    cin.tie(nullptr);
-    bool run = (argc>1 && string(argv[1])=="--run");
-    bool emit = (argc>1 && string(argv[1])=="--emit");
-    string src((istreambuf_iterator<char>(cin)), {});
-    string norm = normalize_longform(src);
+// -------- Source input: read-only mmap (zero-copy), stdin as fallback
+struct MappedFile {
+    const char* data=nullptr; size_t size=0;
+#ifdef _WIN32
+    HANDLE file=INVALID_HANDLE_VALUE, mapping=nullptr;
+    explicit MappedFile(const string& path){
+        file=CreateFileA(path.c_str(),GENERIC_READ,FILE_SHARE_READ,nullptr,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,nullptr);
+        if(file==INVALID_HANDLE_VALUE) throw runtime_error("cannot open '"+path+"'");
+        LARGE_INTEGER sz; if(!GetFileSizeEx(file,&sz)){ CloseHandle(file); throw runtime_error("cannot stat '"+path+"'"); }
+        size=size_t(sz.QuadPart); if(!size) return;
+        mapping=CreateFileMappingA(file,nullptr,PAGE_READONLY,0,0,nullptr);
+        if(mapping) data=(const char*)MapViewOfFile(mapping,FILE_MAP_READ,0,0,0);
+        if(!data){ if(mapping) CloseHandle(mapping); CloseHandle(file); throw runtime_error("cannot map '"+path+"'"); }
+    }
+    ~MappedFile(){ if(data) UnmapViewOfFile(data); if(mapping) CloseHandle(mapping); if(file!=INVALID_HANDLE_VALUE) CloseHandle(file); }
+#else
+    explicit MappedFile(const string& path){
+        int fd=open(path.c_str(),O_RDONLY);
+        if(fd<0) throw runtime_error("cannot open '"+path+"'");
+        struct stat st; if(fstat(fd,&st)!=0){ close(fd); throw runtime_error("cannot stat '"+path+"'"); }
+        size=size_t(st.st_size);
+        if(size){
+            void* p=mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+            if(p==MAP_FAILED){ close(fd); throw runtime_error("cannot map '"+path+"'"); }
+            data=(const char*)p;
+        }
+        close(fd);
+    }
+    ~MappedFile(){ if(data) munmap((void*)data,size); }
+#endif
+    MappedFile(const MappedFile&)=delete; MappedFile& operator=(const MappedFile&)=delete;
+    string_view view() const { return size? string_view(data,size) : string_view(); }
+};
+
+// Compile and run/emit one module; `label` prefixes output when several files are given.
+int compile_one(string_view src, bool run, bool emit, const string& label){
     try{
+        string norm = normalize_longform(src);
         Lexer lex(norm);
         Parser p(lex);
         Module mod = p.parseModule();
@@ -326,6 +486,7 @@ int main(int argc, char** argv){
             // Choose mode: AOT or frame-by-frame JIT
             bool useFrameJit=false;
             if(norm.find("swear_by_frame_jit")!=string::npos) useFrameJit=true;
+            if(!label.empty()) cout<<label<<": ";
 
             if(useFrameJit){
                 int64_t result=0;
@@ -340,6 +501,7 @@ int main(int argc, char** argv){
             }
             return 0;
         } else if(emit){
+            if(!label.empty()) cout<<"; "<<label<<"\n";
             // HEX dump
             cout << "; PARASHADE v0.1 HEX IR ("<< em.code.bytes.size() <<" bytes)\n";
             cout << hex << setfill('0');
@@ -350,11 +512,37 @@ int main(int argc, char** argv){
             cout<<dec<<"\n\n; METADATA\n"<< meta_json(mod, typer) <<"\n";
             return 0;
         } else {
-            cerr<<"Usage: --run | --emit (reads source from stdin)\n";
+            cerr<<"Usage: --run | --emit [file.psd ...] (reads source from stdin if no files)\n";
             return 1;
         }
     } catch(const exception& e){
-        cerr<<"Compile/Run error: "<<e.what()<<"\n";
+        cerr<<(label.empty()? "" : label+": ")<<"Compile/Run error: "<<e.what()<<"\n";
         return 2;
     }
 }
+
+// -------- Driver
+int main(int argc, char** argv){
+    ios::sync_with_stdio(false);
+    cin.tie(nullptr);
+    string mode = argc>1? argv[1] : "";
+    bool run = mode=="--run", emit = mode=="--emit";
+    if(mode=="--bench-normalize"){
+        string src((istreambuf_iterator<char>(cin)), {});
+        return bench_normalize(src, argc>2? atoi(argv[2]) : 20);
+    }
+    if(argc<=2){
+        string src((istreambuf_iterator<char>(cin)), {});
+        return compile_one(src, run, emit, "");
+    }
+    int rc=0;
+    for(int i=2;i<argc;i++){
+        try{
+            MappedFile mf(argv[i]);
+            rc = max(rc, compile_one(mf.view(), run, emit, argc>3? argv[i] : ""));
+        } catch(const exception& e){
+            cerr<<e.what()<<"\n"; rc = max(rc, 2);
+        }
+    }
+    return rc;
+}
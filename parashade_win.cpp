@@ -4,6 +4,18 @@
 // Usage:  type file.psd | parashade.exe --run
 //         type file.psd | parashade.exe --emit
 //         type file.psd | parashade.exe --emit-nasm .out
+//         parashade.exe --run a.psd b.psd      (files are memory-mapped; stdin if none)
+//         parashade.exe --build -j 8 -o out a.psd b.psd ...   (out/<stem>.parx + .meta.json per module)
+//         parashade.exe --run out/a.parx          (verified before it runs; bad bytecode is rejected)
+//         type file.psd | parashade.exe --bench-normalize [reps]
+//         type file.psd | parashade.exe --bench-scan [reps]
+//         parashade.exe --bench-vm [reps] a.psd ...   (stack VM: switch vs threaded dispatch)
+//         add --unfused to normalize to core text before lexing (default: fused)
+//         add --stream to lex through a fixed token window (automatic for sources >= 64 MiB)
+//         add -O0 / -O1 / -O2 to pick the optimization level (default -O2; -O0: no SSA pass, no peephole)
+//         add --profile-pairs to --run to print the hottest executed opcode pairs
+//         add --vm=reg to --run on the register-IR interpreter (with --emit: list the register IR)
+//         add --ct-steps N to set the ever_exact compile-time evaluation budget (default 1000000)
 //
 // New in v0.3
 // - Conditionals (if/else) via JZ/JMP, label patching
@@ -19,6 +31,9 @@
 #include <algorithm>
 #include <array>
 #include <cctype>
+#include <chrono>
+#include <cstring>
+#include <deque>
 #include <cstdint>
 #include <exception>
 #include <fstream>
@@ -27,15 +42,59 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <regex>
 #include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PARASHADE_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define PS_TARGET_SSE2
+#define PS_TARGET_AVX2
+#else
+#include <immintrin.h>
+#include <x86intrin.h>
+#define PS_TARGET_SSE2 __attribute__((target("sse2")))
+#define PS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define PARASHADE_X86 0
+#endif
+
+// Labels-as-values (GCC/Clang, including clang-cl) for the VM's threaded
+// dispatch; -DPARASHADE_NO_THREADED forces the portable switch loop.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(PARASHADE_NO_THREADED)
+#define PARASHADE_THREADED 1
+#else
+#define PARASHADE_THREADED 0
+#endif
+// An empty asm with a unique comment per dispatch site: the tails are then no
+// longer identical, so GCC's cross-jumping cannot merge them back into one.
+#define PS_STR2(x) #x
+#define PS_STR(x) PS_STR2(x)
+#define PS_DISPATCH_SITE __asm__ volatile("# dispatch " PS_STR(__COUNTER__))
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 using std::string;
 
 // ----------------- Utils
@@ -46,202 +105,733 @@ static inline string trim(string s){
 }
 static inline bool starts_with(const string& s, const string& p){ return s.rfind(p,0)==0; }
 static inline string lowerc(string s){ for(char& c:s) c=char(tolower((unsigned char)c)); return s; }
+static inline string lowerc(std::string_view s){ return lowerc(string(s)); }
 
-// ----------------- Long-form → Core normalizer (brief)
-static string normalize_longform(const string& in){
+// ----------------- Long-form → Core normalizer
+// Phrase table. Words are matched whole (\b…\b); a single space between words
+// matches any run of in-line whitespace, and a trailing space means the phrase
+// also swallows the whitespace after it (the `\s+` tail of the declare rules).
+// `end` is only the long-form declaration terminator on a line that opens with
+// `declare …`; anywhere else it is the core block `end` and is kept.
+enum PhraseCtx : uint8_t { PC_Any, PC_OpensDecl, PC_DeclOnly };
+struct Phrase{ const char* pat; const char* repl; PhraseCtx ctx; };
+static const Phrase kPhraseTable[] = {
+    {"declare explicit integer named ", "let int ", PC_OpensDecl},
+    {"declare implicit named ",          "let ",     PC_OpensDecl},
+    {"equals",                           "=",        PC_Any},
+    {"end",                              "",         PC_DeclOnly},
+    {"plus",                             "+",        PC_Any},
+    {"greatest_of",                      "max",      PC_Any},
+    {"least_of",                         "min",      PC_Any},
+    {"module",                           "module",   PC_Any},
+    {"scope",                            "scope",    PC_Any},
+    {"range",                            "range",    PC_Any},
+    {"return",                           "return",   PC_Any},
+};
+
+// Byte classes for the scanners: \w (regex word char) and \s (isspace).
+struct CharClass{
+    bool word[256]{}, space[256]{};
+    CharClass(){ for(int c=0;c<256;c++){ word[c]=std::isalnum(c)||c=='_'; space[c]=std::isspace(c)!=0; } }
+};
+static const CharClass kCC;
+static inline bool is_word(char c){ return kCC.word[(unsigned char)c]; }
+static inline bool is_space(char c){ return kCC.space[(unsigned char)c]; }
+static inline bool is_inline_space(char c){ return c!='\n' && kCC.space[(unsigned char)c]; }
+
+// ----------------- Character-class scanner (SIMD, runtime dispatch)
+// classify64 sets one bit per byte for 64 bytes at p (all readable). ClassScan
+// caches the masks of the current block so the front end can skip whitespace
+// and word runs with a shift + ctz instead of one table test per byte.
+struct ClassMasks{ uint64_t nl, semi, hspace, word; };   // hspace = isspace minus '\n'
+using Classify64Fn = void(*)(const char*, ClassMasks&);
+
+static void classify64_scalar(const char* p, ClassMasks& m){
+    uint64_t nl=0, semi=0, hs=0, w=0;
+    for(int i=0;i<64;i++){
+        const char c=p[i]; const uint64_t bit=uint64_t(1)<<i;
+        if(c=='\n') nl|=bit; else if(is_space(c)) hs|=bit;
+        if(c==';') semi|=bit;
+        if(is_word(c)) w|=bit;
+    }
+    m={nl,semi,hs,w};
+}
+
+#if PARASHADE_X86
+// byte-wise unsigned x <= k
+PS_TARGET_SSE2 static inline __m128i le_u8(__m128i x, char k){ return _mm_cmpeq_epi8(_mm_subs_epu8(x,_mm_set1_epi8(k)),_mm_setzero_si128()); }
+PS_TARGET_AVX2 static inline __m256i le_u8(__m256i x, char k){ return _mm256_cmpeq_epi8(_mm256_subs_epu8(x,_mm256_set1_epi8(k)),_mm256_setzero_si256()); }
+
+PS_TARGET_SSE2 static void classify64_sse2(const char* p, ClassMasks& m){
+    uint64_t nl=0, semi=0, hs=0, w=0;
+    for(int i=0;i<4;i++){
+        const __m128i x=_mm_loadu_si128((const __m128i*)(p+16*i));
+        const __m128i n=_mm_cmpeq_epi8(x,_mm_set1_epi8('\n'));
+        const __m128i sp=_mm_or_si128(_mm_cmpeq_epi8(x,_mm_set1_epi8(' ')), le_u8(_mm_sub_epi8(x,_mm_set1_epi8(9)),4));
+        const __m128i alpha=le_u8(_mm_sub_epi8(_mm_or_si128(x,_mm_set1_epi8(0x20)),_mm_set1_epi8('a')),25);
+        const __m128i digit=le_u8(_mm_sub_epi8(x,_mm_set1_epi8('0')),9);
+        const __m128i wd=_mm_or_si128(_mm_or_si128(alpha,digit),_mm_cmpeq_epi8(x,_mm_set1_epi8('_')));
+        const int sh=16*i;
+        nl  |=uint64_t((uint32_t)_mm_movemask_epi8(n))<<sh;
+        semi|=uint64_t((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x,_mm_set1_epi8(';'))))<<sh;
+        hs  |=uint64_t((uint32_t)_mm_movemask_epi8(_mm_andnot_si128(n,sp)))<<sh;
+        w   |=uint64_t((uint32_t)_mm_movemask_epi8(wd))<<sh;
+    }
+    m={nl,semi,hs,w};
+}
+
+PS_TARGET_AVX2 static void classify64_avx2(const char* p, ClassMasks& m){
+    uint64_t nl=0, semi=0, hs=0, w=0;
+    for(int i=0;i<2;i++){
+        const __m256i x=_mm256_loadu_si256((const __m256i*)(p+32*i));
+        const __m256i n=_mm256_cmpeq_epi8(x,_mm256_set1_epi8('\n'));
+        const __m256i sp=_mm256_or_si256(_mm256_cmpeq_epi8(x,_mm256_set1_epi8(' ')), le_u8(_mm256_sub_epi8(x,_mm256_set1_epi8(9)),4));
+        const __m256i alpha=le_u8(_mm256_sub_epi8(_mm256_or_si256(x,_mm256_set1_epi8(0x20)),_mm256_set1_epi8('a')),25);
+        const __m256i digit=le_u8(_mm256_sub_epi8(x,_mm256_set1_epi8('0')),9);
+        const __m256i wd=_mm256_or_si256(_mm256_or_si256(alpha,digit),_mm256_cmpeq_epi8(x,_mm256_set1_epi8('_')));
+        const int sh=32*i;
+        nl  |=uint64_t((uint32_t)_mm256_movemask_epi8(n))<<sh;
+        semi|=uint64_t((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x,_mm256_set1_epi8(';'))))<<sh;
+        hs  |=uint64_t((uint32_t)_mm256_movemask_epi8(_mm256_andnot_si256(n,sp)))<<sh;
+        w   |=uint64_t((uint32_t)_mm256_movemask_epi8(wd))<<sh;
+    }
+    m={nl,semi,hs,w};
+}
+
+static bool cpu_has_avx2(){
+#if defined(_MSC_VER) && !defined(__clang__)
+    int r[4]; __cpuid(r,0); if(r[0]<7) return false;
+    __cpuid(r,1); if(!((r[2]>>27)&1)) return false;            // OSXSAVE
+    if((_xgetbv(0)&6)!=6) return false;                         // OS saves YMM state
+    __cpuidex(r,7,0); return (r[1]>>5)&1;
+#else
+    __builtin_cpu_init(); return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+static const char* classify64_name="scalar";
+static Classify64Fn pick_classify64(){
+#if PARASHADE_X86
+    if(cpu_has_avx2()){ classify64_name="avx2"; return classify64_avx2; }
+    classify64_name="sse2"; return classify64_sse2;
+#else
+    return classify64_scalar;
+#endif
+}
+static Classify64Fn classify64=pick_classify64();
+
+static inline unsigned ctz64(uint64_t v){
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long i; _BitScanForward64(&i,v); return unsigned(i);
+#else
+    return unsigned(__builtin_ctzll(v));
+#endif
+}
+
+struct ClassScan{
+    const char* B; const char* E; const char* blk=nullptr; ClassMasks m{};
+    ClassScan(const char* b, const char* e):B(b),E(e){}
+    void load(const char* p){
+        blk=B+(size_t(p-B)&~size_t(63));
+        if(E-blk>=64) classify64(blk,m);
+        else { char tail[64]={}; std::memcpy(tail,blk,size_t(E-blk)); classify64(tail,m); } // NUL is in no class
+    }
+    // First position in [p,lim) whose byte is not (span) / is (find) in class `cls`; lim if none.
+    const char* span(const char* p, uint64_t ClassMasks::*cls, const char* lim){ return scan(p,cls,lim,~uint64_t(0)); }
+    const char* find(const char* p, uint64_t ClassMasks::*cls, const char* lim){ return scan(p,cls,lim,0); }
+    const char* scan(const char* p, uint64_t ClassMasks::*cls, const char* lim, uint64_t flip){
+        while(p<lim){
+            if(p<blk || p>=blk+64) load(p);
+            const uint64_t hits=((m.*cls)^flip)>>(p-blk);
+            if(hits){ const char* q=p+ctz64(hits); return q<lim? q:lim; }
+            p=blk+64;
+        }
+        return lim;
+    }
+};
+
+// Word-level trie compiled once from kPhraseTable. No phrase may be a word-prefix
+// of another, so the first terminal node reached is the match. Replacements are
+// stored back to back in `pool`, one per line, so the lexer can tokenize them once.
+struct PhraseTrie{
+    struct Node{ std::vector<std::pair<string,int>> next; int rule=-1; bool eatWs=false; };
+    std::vector<Node> nodes{1};
+    std::vector<string> repl;
+    std::vector<PhraseCtx> ctx;
+    string pool;
+    PhraseTrie(){
+        for(auto& ph:kPhraseTable){
+            string pat=ph.pat; bool eatWs=!pat.empty() && pat.back()==' ';
+            if(eatWs) pat.pop_back();
+            int n=0; std::istringstream ws(pat); string w;
+            while(ws>>w){
+                int c=child(n,w.data(),w.size());
+                if(c<0){ c=(int)nodes.size(); nodes[n].next.push_back({w,c}); nodes.emplace_back(); }
+                n=c;
+            }
+            nodes[n].rule=(int)repl.size(); nodes[n].eatWs=eatWs;
+            repl.push_back(ph.repl); ctx.push_back(ph.ctx);
+            pool+=ph.repl; pool+='\n';
+        }
+    }
+    int child(int n, const char* w, size_t len) const {
+        for(auto& e:nodes[n].next) if(e.first.size()==len && std::memcmp(e.first.data(),w,len)==0) return e.second;
+        return -1;
+    }
+    // Match a phrase whose first word is [w,we), never crossing `le` or a newline.
+    // Returns the rule index and sets `end` past the consumed text, or -1.
+    // `declLine` carries the PC_* context for the current line.
+    int match(const char* w, const char* we, const char* le, bool atLineStart, bool& declLine, const char*& end) const {
+        int n=child(0,w,size_t(we-w));
+        while(n>=0){
+            const Node& N=nodes[n];
+            const char* s=we; while(s<le && is_inline_space(*s)) ++s;
+            if(N.rule>=0){
+                if(N.eatWs && s==we) return -1;
+                if(ctx[(size_t)N.rule]==PC_DeclOnly && !declLine) return -1;
+                if(ctx[(size_t)N.rule]==PC_OpensDecl && atLineStart) declLine=true;
+                end=N.eatWs? s:we; return N.rule;
+            }
+            if(s==we || s==le || !is_word(*s)) return -1;
+            const char* t=s; while(t<le && is_word(*t)) ++t;
+            n=child(n,s,size_t(t-s)); we=t;
+        }
+        return -1;
+    }
+};
+static const PhraseTrie& phrase_trie(){ static const PhraseTrie t; return t; }
+
+// One linear scan over the whole buffer: strip ';' comments, rewrite phrases,
+// trim each line. Output is byte-identical to normalize_longform_regex.
+static string normalize_longform(std::string_view in){
+    const PhraseTrie& trie=phrase_trie();
+    string out; out.reserve(in.size());
+    const char* p=in.data(); const char* const E=p+in.size();
+    ClassScan cs(p,E);
+    while(p<E){
+        const char* nl=(const char*)std::memchr(p,'\n',size_t(E-p));
+        const char* le=nl? nl:E;
+        const char* sc=(const char*)std::memchr(p,';',size_t(le-p));
+        const char* ce=sc? sc:le;
+        const size_t lineStart=out.size(); bool declLine=false;
+        auto put=[&](const char* s, size_t n){
+            if(out.size()==lineStart) while(n && is_space(*s)){ ++s; --n; } // leading trim
+            out.append(s,n);
+        };
+        const char* q=p;
+        while(q<ce){
+            if(is_word(*q)){
+                const char* w=q; q=cs.span(q,&ClassMasks::word,ce);
+                const char* mEnd=nullptr; int r=trie.match(w,q,ce,out.size()==lineStart,declLine,mEnd);
+                if(r>=0){ const string& R=trie.repl[(size_t)r]; put(R.data(),R.size()); q=mEnd; }
+                else put(w,size_t(q-w));
+            } else {
+                const char* s=q; q=cs.find(q,&ClassMasks::word,ce);
+                put(s,size_t(q-s));
+            }
+        }
+        while(out.size()>lineStart && is_space(out.back())) out.pop_back(); // trailing trim
+        out.push_back('\n');
+        p=nl? nl+1:E;
+    }
+    return out;
+}
+
+// Reference implementation: the per-line std::regex chain the automaton replaced.
+// Kept for --bench-normalize, which checks both produce identical output.
+static string normalize_longform_regex(const string& in){
     static const std::vector<std::pair<std::regex,string>> M = {
         {std::regex("\\bdeclare\\s+explicit\\s+integer\\s+named\\s+"), "let int "},
         {std::regex("\\bdeclare\\s+implicit\\s+named\\s+"),            "let "},
         {std::regex("\\bequals\\b"),                                   "="},
-        {std::regex("\\bend\\b"),                                      ""},
         {std::regex("\\bplus\\b"),                                     "+"},
+        {std::regex("\\bgreatest_of\\b"),                              "max"},
+        {std::regex("\\bleast_of\\b"),                                 "min"},
         {std::regex("\\bmodule\\b"),                                   "module"},
         {std::regex("\\bscope\\b"),                                    "scope"},
         {std::regex("\\brange\\b"),                                    "range"},
         {std::regex("\\breturn\\b"),                                   "return"},
     };
+    static const std::regex declOpen("^\\s*declare\\s+(explicit\\s+integer|implicit)\\s+named\\s"), declEnd("\\bend\\b");
     std::ostringstream out;
     std::istringstream iss(in); string line;
     while(std::getline(iss,line)){
         auto sc=line.find(';'); if(sc!=string::npos) line=line.substr(0,sc);
         string L=line;
+        bool decl=std::regex_search(L,declOpen);
         for(auto& p:M) L=std::regex_replace(L,p.first,p.second);
+        if(decl) L=std::regex_replace(L,declEnd,"");
         out<<trim(L)<<"\n";
     }
     return out.str();
 }
 
+static int bench_normalize(const string& src, int reps){
+    using clk=std::chrono::steady_clock;
+    if(normalize_longform(src)!=normalize_longform_regex(src)){
+        std::cerr<<"bench: phrase automaton output differs from regex chain\n"; return 3;
+    }
+    size_t outBytes=0;
+    auto time_it=[&](auto fn){
+        auto t0=clk::now();
+        for(int i=0;i<reps;i++) outBytes+=fn(src).size();
+        return std::chrono::duration<double>(clk::now()-t0).count();
+    };
+    double tr=time_it([](const string& x){ return normalize_longform_regex(x); });
+    double ta=time_it([](const string& x){ return normalize_longform(x); });
+    double mb=double(src.size())*reps/1e6;
+    std::cout<<std::fixed<<std::setprecision(2)
+             <<"normalize: "<<src.size()<<" bytes x "<<reps<<" reps ("<<outBytes/(2*size_t(reps>0?reps:1))<<" bytes out, identical)\n"
+             <<"  regex chain     : "<<tr*1e3<<" ms  "<<mb/tr<<" MB/s\n"
+             <<"  phrase automaton: "<<ta*1e3<<" ms  "<<mb/ta<<" MB/s\n"
+             <<"  speedup         : "<<tr/ta<<"x\n";
+    return 0;
+}
+
 // ----------------- Lexer
-enum class Tok {
+enum class Tok : uint8_t {
     End, Ident, Number,
     Colon, Equals, Plus, Comma,
     LParen, RParen,
     KwModule, KwScope, KwRange, KwLet, KwInt, KwArr, KwReturn, KwEnd, KwIf, KwElse
 };
-struct Token{ Tok t; string s; int line; };
+// 12-byte token record; the text is [off, off+len) of the lexer's source buffer,
+// or of phrase_trie().pool for tokens synthesized from a long-form phrase.
+struct Token{ uint32_t off; uint32_t line; uint16_t len; Tok t; bool synth=false; };
+
+static Tok keyword_or_ident(const char* s, size_t n){
+    static const std::pair<const char*,Tok> kw[] = {
+        {"module",Tok::KwModule},{"scope",Tok::KwScope},{"range",Tok::KwRange},{"let",Tok::KwLet},
+        {"int",Tok::KwInt},{"arr",Tok::KwArr},{"return",Tok::KwReturn},{"end",Tok::KwEnd},
+        {"if",Tok::KwIf},{"else",Tok::KwElse},
+    };
+    if(n<2 || n>6) return Tok::Ident;
+    char b[6]; for(size_t k=0;k<n;k++) b[k]=char(tolower((unsigned char)s[k]));
+    for(auto& k:kw) if(std::strlen(k.first)==n && std::memcmp(k.first,b,n)==0) return k.second;
+    return Tok::Ident;
+}
 
+// Zero-copy lexer over one contiguous buffer; the buffer must outlive the Lexer.
+// With longForm set, long-form phrases are rewritten to core tokens while
+// scanning (fused normalize+lex): the token stream equals that of
+// Lexer(normalize_longform(src)) without materializing the normalized text.
+//
+// Eager mode tokenizes everything up front into `toks`. Streaming mode (window>0)
+// is pull-based: peek() refills a fixed ring of `window` tokens only when it runs
+// dry, so token memory is constant for any input size. Token offsets are relative
+// to the refill position (`base`), which lifts the 4 GiB limit; read a token's
+// text before the next peek/pop.
 struct Lexer{
-    std::vector<Token> toks; size_t i=0;
-    explicit Lexer(const string& src){
-        std::istringstream iss(src); string line; int ln=0;
-        while(std::getline(iss,line)){
-            ++ln;
-            auto sc=line.find(';'); if(sc!=string::npos) line=line.substr(0,sc);
-            std::istringstream ls(line);
-            for(;;){
-                int c=ls.peek(); if(c==EOF) break;
-                if(isspace(c)){ ls.get(); continue; }
-                if(c=='('){ toks.push_back({Tok::LParen,"(",ln}); ls.get(); continue; }
-                if(c==')'){ toks.push_back({Tok::RParen,")",ln}); ls.get(); continue; }
-                if(c==','){ toks.push_back({Tok::Comma,",",ln}); ls.get(); continue; }
-                if(c==':'){ toks.push_back({Tok::Colon,":",ln}); ls.get(); continue; }
-                if(c=='='){ toks.push_back({Tok::Equals,"=",ln}); ls.get(); continue; }
-                if(c=='+'){ toks.push_back({Tok::Plus,"+",ln}); ls.get(); continue; }
-
-                if(std::isalpha(c) || c=='_'){
-                    string id; while(std::isalnum(ls.peek())||ls.peek()=='_') id.push_back(char(ls.get()));
-                    string lid=lowerc(id);
-                    if(lid=="module") toks.push_back({Tok::KwModule,id,ln});
-                    else if(lid=="scope") toks.push_back({Tok::KwScope,id,ln});
-                    else if(lid=="range") toks.push_back({Tok::KwRange,id,ln});
-                    else if(lid=="let") toks.push_back({Tok::KwLet,id,ln});
-                    else if(lid=="int") toks.push_back({Tok::KwInt,id,ln});
-                    else if(lid=="arr") toks.push_back({Tok::KwArr,id,ln});
-                    else if(lid=="return") toks.push_back({Tok::KwReturn,id,ln});
-                    else if(lid=="end") toks.push_back({Tok::KwEnd,id,ln});
-                    else if(lid=="if") toks.push_back({Tok::KwIf,id,ln});
-                    else if(lid=="else") toks.push_back({Tok::KwElse,id,ln});
-                    else toks.push_back({Tok::Ident,lid,ln});
-                    continue;
-                }
-                // numbers
-                if(c=='0'){
-                    string num; num.push_back(char(ls.get()));
-                    if(tolower(ls.peek())=='x'){ num.push_back(char(ls.get()));
-                        while(std::isxdigit(ls.peek())||ls.peek()=='_') num.push_back(char(ls.get()));
-                        toks.push_back({Tok::Number,num,ln}); continue;
-                    } else {
-                        while(std::isdigit(ls.peek())) num.push_back(char(ls.get()));
-                        toks.push_back({Tok::Number,num,ln}); continue;
-                    }
-                }
-                if(std::isdigit(c)){
-                    string num; while(std::isdigit(ls.peek())) num.push_back(char(ls.get()));
-                    toks.push_back({Tok::Number,num,ln}); continue;
+    std::string_view src;
+    std::vector<Token> toks; size_t i=0;       // eager: all tokens; streaming: the ring
+    bool streaming=false; size_t head=0, count=0, mask=0; uint64_t base=0;
+    // scanner state
+    const char* B; const char* E; const char* p; const char* runEnd;   // runEnd: end of the word run last offered to the trie
+    ClassScan cs;
+    const std::vector<std::vector<Token>>* phraseToks=nullptr;
+    bool atLineStart=true, declLine=false, atEof=false;
+    uint32_t ln=1, endLine=0;
+
+    explicit Lexer(std::string_view s, bool longForm=false, size_t window=0)
+        :src(s),B(s.data()),E(s.data()+s.size()),p(B),runEnd(B),cs(B,E){
+        if(longForm) phraseToks=&phrase_tokens();
+        if(window){
+            size_t w=16; while(w<window) w<<=1;
+            streaming=true; toks.resize(w); mask=w-1;
+            return;
+        }
+        if(src.size()>UINT32_MAX) throw std::runtime_error("source too large for eager lexing (4 GiB); use --stream");
+        while(!atEof) scan();
+        toks.shrink_to_fit(); // drop the geometric-growth slack; tokens live until parsing ends
+    }
+
+    void emit(Token t){
+        if(!streaming){ toks.push_back(t); return; }
+        toks[(head+count)&mask]=t; ++count;
+    }
+    void push(Tok t, const char* at, size_t n){
+        if(n>0xFFFF) throw std::runtime_error("token too long at line "+std::to_string(ln));
+        uint64_t off=uint64_t(at-B)-base;
+        if(off>UINT32_MAX) throw std::runtime_error("gap between tokens exceeds 4 GiB at line "+std::to_string(ln));
+        emit({uint32_t(off),ln,uint16_t(n),t});
+        atLineStart=false;
+    }
+    // Scan until at least one token is emitted (a dropped phrase emits none) or EOF.
+    void scan(){
+        const PhraseTrie& trie=phrase_trie();
+        while(p<E){
+            const char c=*p;
+            if(c=='\n'){ ++ln; ++p; atLineStart=true; declLine=false; continue; }
+            if(c==';'){ auto nl=(const char*)std::memchr(p,'\n',size_t(E-p)); p=nl? nl:E; continue; }
+            if(is_space(c)){ p=cs.span(p,&ClassMasks::hspace,E); continue; }
+            if(phraseToks && p>=runEnd && is_word(c)){
+                const char* we=cs.span(p,&ClassMasks::word,E);
+                const char* mEnd=nullptr; int r=trie.match(p,we,E,atLineStart,declLine,mEnd);
+                if(r>=0){
+                    const auto& pt=(*phraseToks)[(size_t)r];
+                    for(Token t:pt){ t.line=ln; emit(t); }
+                    atLineStart=false; p=runEnd=mEnd;
+                    if(pt.empty()) continue;
+                    return;
                 }
-                ls.get(); // skip unknown
+                runEnd=we; // lex the unmatched run as core text
+            }
+            switch(c){
+                case '(': push(Tok::LParen,p++,1); return;
+                case ')': push(Tok::RParen,p++,1); return;
+                case ',': push(Tok::Comma,p++,1);  return;
+                case ':': push(Tok::Colon,p++,1);  return;
+                case '=': push(Tok::Equals,p++,1); return;
+                case '+': push(Tok::Plus,p++,1);   return;
+                default: break;
+            }
+            const char* s0=p;
+            if(std::isalpha((unsigned char)c) || c=='_'){
+                p=cs.span(p,&ClassMasks::word,E);
+                push(keyword_or_ident(s0,size_t(p-s0)),s0,size_t(p-s0)); return;
             }
+            if(c=='0' && p+1<E && (p[1]=='x'||p[1]=='X')){
+                p+=2; while(p<E && (std::isxdigit((unsigned char)*p)||*p=='_')) ++p;
+                push(Tok::Number,s0,size_t(p-s0)); return;
+            }
+            if(std::isdigit((unsigned char)c)){
+                while(p<E && std::isdigit((unsigned char)*p)) ++p;
+                push(Tok::Number,s0,size_t(p-s0)); return;
+            }
+            ++p; atLineStart=false; // skip unknown
         }
-        toks.push_back({Tok::End,"",ln});
+        endLine = src.empty()? 0 : (src.back()=='\n'? ln-1 : ln);
+        emit({0,endLine,0,Tok::End}); atEof=true;
     }
-    const Token& peek() const { return toks[i]; }
-    Token pop(){ return toks[i++]; }
-    bool accept(Tok t){ if(peek().t==t){ ++i; return true; } return false; }
+    // Streaming: refill the (empty) ring from the current scan position.
+    void refill(){
+        head=0; base=uint64_t(p-B);
+        if(atEof){ emit({0,endLine,0,Tok::End}); return; } // keep answering End
+        while(!atEof && count+4<=toks.size()) scan();             // a scan emits at most 2 tokens
+    }
+
+    // Core tokens of each phrase replacement, lexed once from phrase_trie().pool.
+    static const std::vector<std::vector<Token>>& phrase_tokens(){
+        static const std::vector<std::vector<Token>> pt=[]{
+            std::vector<std::vector<Token>> v(phrase_trie().repl.size());
+            Lexer L(phrase_trie().pool);
+            for(Token t:L.toks) if(t.t!=Tok::End){ t.synth=true; v[t.line-1].push_back(t); }
+            return v;
+        }();
+        return pt;
+    }
+    std::string_view text(const Token& t) const { return t.synth? std::string_view(phrase_trie().pool).substr(t.off,t.len) : src.substr(size_t(base+t.off),t.len); }
+    const Token& peek(){
+        if(!streaming) return toks[i];
+        if(!count) refill();
+        return toks[head];
+    }
+    Token pop(){ Token t=peek(); advance(); return t; }
+    void advance(){ if(streaming){ head=(head+1)&mask; --count; } else ++i; }
+    bool accept(Tok t){ if(peek().t==t){ advance(); return true; } return false; }
     void expect(Tok t, const char* msg){ if(!accept(t)) throw std::runtime_error(string("Parse error: expected ")+msg+" at line "+std::to_string(peek().line)); }
 };
 
+// --bench-scan: classifier throughput per implementation (bytes per TSC cycle on
+// x86, bytes/ns elsewhere), then front-end time with each one plugged in.
+static int bench_scan(const string& src, int reps){
+    struct Impl{ const char* name; Classify64Fn fn; };
+    std::vector<Impl> impls{{"scalar",classify64_scalar}};
+#if PARASHADE_X86
+    impls.push_back({"sse2",classify64_sse2});
+    if(cpu_has_avx2()) impls.push_back({"avx2",classify64_avx2});
+#endif
+    const Classify64Fn chosen=classify64;
+    string buf=src; buf.resize((buf.size()+63)&~size_t(63),' ');
+    std::cout<<std::fixed<<std::setprecision(3)<<"scan: "<<src.size()<<" bytes x "<<reps<<" reps, dispatch picks "<<classify64_name<<"\n";
+    for(auto& im:impls){
+        uint64_t sink=0; ClassMasks m;
+        auto t0=std::chrono::steady_clock::now();
+#if PARASHADE_X86
+        const uint64_t c0=__rdtsc();
+#endif
+        for(int r=0;r<reps;r++) for(size_t k=0;k<buf.size();k+=64){ im.fn(buf.data()+k,m); sink+=m.nl^m.semi^m.hspace^m.word; }
+#if PARASHADE_X86
+        const double cyc=double(__rdtsc()-c0);
+#endif
+        const double ns=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-t0).count();
+        const double bytes=double(buf.size())*reps;
+        classify64=im.fn;
+        auto t1=std::chrono::steady_clock::now(); size_t toks=0;
+        for(int r=0;r<reps;r++) toks+=Lexer(src,true).toks.size()+normalize_longform(src).size();
+        const double fe=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-t1).count();
+        std::cout<<"  "<<std::setw(6)<<im.name<<": classify "
+#if PARASHADE_X86
+                 <<bytes/cyc<<" B/cycle, "
+#endif
+                 <<bytes/ns<<" B/ns | lex+normalize "<<fe/reps<<" ms/rep  (check "<<((sink^toks)&0xff)<<")\n";
+    }
+    classify64=chosen;
+    return 0;
+}
+
+// ----------------- Symbols
+// Built-in calls, resolved once by the parser. Their names are interned first,
+// so an intrinsic's symbol id equals its enum value.
+enum class Intrinsic : uint8_t {
+    None, Max, Min, EverExact, UtterlyInline,
+    Gt, Lt, Ge, Le, Eq, Ne,
+    ArrNew, ArrGet, ArrSet, ArrOf,
+    Count
+};
+static const char* const kIntrinsicNames[] = {
+    "", "max", "min", "ever_exact", "utterly_inline",
+    "gt", "lt", "ge", "le", "eq", "ne",
+    "arr_new", "arr_get", "arr_set", "arr_of",
+};
+static_assert(sizeof(kIntrinsicNames)/sizeof(*kIntrinsicNames)==size_t(Intrinsic::Count),"intrinsic table");
+
+// Interned identifier table: lower-cased name <-> dense id. Names live in a
+// deque so the string_view keys stay valid as the table grows. One table per
+// thread (build workers parse concurrently); ids never cross threads.
+struct SymbolTable{
+    std::deque<string> names;
+    std::unordered_map<std::string_view,uint32_t> ids;
+    SymbolTable(){ for(auto* n:kIntrinsicNames) intern(n); }
+    uint32_t intern(std::string_view raw){
+        char buf[64]; string big; std::string_view key;
+        if(raw.size()<=sizeof(buf)){ for(size_t k=0;k<raw.size();k++) buf[k]=char(tolower((unsigned char)raw[k])); key=std::string_view(buf,raw.size()); }
+        else { big=lowerc(raw); key=big; }
+        auto it=ids.find(key); if(it!=ids.end()) return it->second;
+        names.emplace_back(key); uint32_t id=uint32_t(names.size()-1);
+        ids.emplace(names.back(),id); return id;
+    }
+    const string& name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+    static Intrinsic intrinsic(uint32_t id){ return id>0 && id<uint32_t(Intrinsic::Count)? Intrinsic(id) : Intrinsic::None; }
+};
+static thread_local SymbolTable gSyms;
+
 // ----------------- AST
+// Nodes live in a per-module arena (Ast) and refer to each other by 32-bit
+// index. Records are 16 bytes and trivially destructible, so a tree is freed by
+// dropping three vectors: no per-node allocation and no recursive destructor,
+// however deep the program. Child lists (call args, block bodies) are runs in
+// Ast::lists stored as [count, id0, id1, ...].
+using NodeId=uint32_t;
+
 struct Expr{
-    enum Kind{ Num, Var, Add, Call } kind;
-    int line=0;
-    uint64_t val=0; string name;
-    std::unique_ptr<Expr> a,b;
-    std::vector<std::unique_ptr<Expr>> args;
-    static std::unique_ptr<Expr> num(uint64_t v,int ln){ auto p=std::make_unique<Expr>(); p->kind=Num; p->val=v; p->line=ln; return p; }
-    static std::unique_ptr<Expr> var(string n,int ln){ auto p=std::make_unique<Expr>(); p->kind=Var; p->name=std::move(n); p->line=ln; return p; }
-    static std::unique_ptr<Expr> add(std::unique_ptr<Expr>A,std::unique_ptr<Expr>B,int ln){ auto p=std::make_unique<Expr>(); p->kind=Add; p->a=std::move(A); p->b=std::move(B); p->line=ln; return p; }
-    static std::unique_ptr<Expr> call(string n,std::vector<std::unique_ptr<Expr>> as,int ln){ auto p=std::make_unique<Expr>(); p->kind=Call; p->name=std::move(n); p->args=std::move(as); p->line=ln; return p; }
+    enum Kind : uint8_t { Num, Var, Add, Call } kind;
+    Intrinsic fn=Intrinsic::None;       // Call target
+    uint32_t line=0;
+    uint32_t a=0, b=0;                  // Num: value lo/hi; Var: sym; Add: lhs/rhs; Call: sym/args list
+    uint64_t value() const { return a|(uint64_t(b)<<32); }
+    uint32_t sym() const { return a; }
+    NodeId lhs() const { return a; }
+    NodeId rhs() const { return b; }
 };
 
 struct Stmt{
-    enum Kind{ Let, Ret, If } kind;
-    int line=0;
-    // Let
-    enum EType { T_Implicit, T_Int, T_Arr } etype = T_Implicit;
-    string name; std::unique_ptr<Expr> expr;
-    // Ret
-    // If
-    std::unique_ptr<Expr> cond;
-    std::vector<Stmt> thenBody, elseBody;
-    static Stmt makeLet(string n,EType et,std::unique_ptr<Expr>e,int ln){ Stmt s; s.kind=Let; s.name=std::move(n); s.etype=et; s.expr=std::move(e); s.line=ln; return s; }
-    static Stmt makeRet(std::unique_ptr<Expr>e,int ln){ Stmt s; s.kind=Ret; s.expr=std::move(e); s.line=ln; return s; }
-    static Stmt makeIf(std::unique_ptr<Expr>c,std::vector<Stmt>t,std::vector<Stmt>e,int ln){ Stmt s; s.kind=If; s.cond=std::move(c); s.thenBody=std::move(t); s.elseBody=std::move(e); s.line=ln; return s; }
-};
-
-struct Func{ string name; int line=0; std::vector<Stmt> body; };
-struct Module{ string name; Func mainFn; };
+    enum Kind : uint8_t { Let, Ret, If } kind;
+    enum EType : uint8_t { T_Implicit, T_Int, T_Arr } etype=T_Implicit;   // Let
+    uint32_t line=0;
+    uint32_t a=0, b=0;                  // Let: sym/expr; Ret: -/expr; If: cond/then list (else list follows)
+    uint32_t sym() const { return a; }
+    NodeId expr() const { return b; }
+    NodeId cond() const { return a; }
+};
+static_assert(sizeof(Expr)==16 && sizeof(Stmt)==16,"compact AST records");
+
+struct Ast{
+    std::vector<Expr> exprs;
+    std::vector<Stmt> stmts;
+    std::vector<uint32_t> lists;
+
+    struct List{
+        const uint32_t* p; uint32_t n;
+        const uint32_t* begin() const { return p; }
+        const uint32_t* end() const { return p+n; }
+        uint32_t size() const { return n; }
+        NodeId operator[](uint32_t i) const { return p[i]; }
+    };
+    const Expr& expr(NodeId id) const { return exprs[id]; }
+    const Stmt& stmt(NodeId id) const { return stmts[id]; }
+    List list(uint32_t at) const { return {lists.data()+at+1,lists[at]}; }
+    List args(const Expr& e) const { return list(e.b); }
+    List then_body(const Stmt& s) const { return list(s.b); }
+    List else_body(const Stmt& s) const { return list(s.b+1+lists[s.b]); }
+
+    NodeId num(uint64_t v,uint32_t ln){ return push(Expr{Expr::Num,Intrinsic::None,ln,uint32_t(v),uint32_t(v>>32)}); }
+    NodeId var(uint32_t sym,uint32_t ln){ return push(Expr{Expr::Var,Intrinsic::None,ln,sym,0}); }
+    NodeId add(NodeId l,NodeId r,uint32_t ln){ return push(Expr{Expr::Add,Intrinsic::None,ln,l,r}); }
+    NodeId call(uint32_t sym,uint32_t args,uint32_t ln){ return push(Expr{Expr::Call,SymbolTable::intrinsic(sym),ln,sym,args}); }
+    NodeId makeLet(uint32_t sym,Stmt::EType et,NodeId e,uint32_t ln){ return push(Stmt{Stmt::Let,et,ln,sym,e}); }
+    NodeId makeRet(NodeId e,uint32_t ln){ return push(Stmt{Stmt::Ret,Stmt::T_Implicit,ln,0,e}); }
+    NodeId makeIf(NodeId c,uint32_t thenList,uint32_t ln){ return push(Stmt{Stmt::If,Stmt::T_Implicit,ln,c,thenList}); }
+    void reset(){ exprs.clear(); stmts.clear(); lists.clear(); }   // keeps capacity
+    // append ids[0..n) as a list; returns its offset in `lists`
+    uint32_t push_list(const uint32_t* ids,size_t n){
+        uint32_t at=(uint32_t)lists.size();
+        lists.push_back((uint32_t)n); lists.insert(lists.end(),ids,ids+n);
+        return at;
+    }
+private:
+    NodeId push(const Expr& e){ exprs.push_back(e); return NodeId(exprs.size()-1); }
+    NodeId push(const Stmt& s){ stmts.push_back(s); return NodeId(stmts.size()-1); }
+};
+
+// A scope is a function: `scope name(a, int b, arr c) range r: ... end`.
+// Parameters take the first frame slots, in order.
+struct Param{ uint32_t sym; Stmt::EType etype; uint32_t line; };
+struct Func{ string name; uint32_t sym=0; int line=0; uint32_t body=0; bool frameJit=false; std::vector<Param> params; };   // body: list of statements in Module::ast
+// funcs[0] is `scope main`, the entry; the others keep source order. A scope's
+// index is its function id (CALL's operand).
+struct Module{
+    string name; std::vector<Func> funcs; Ast ast;
+    int find(uint32_t sym) const { for(size_t k=0;k<funcs.size();++k) if(funcs[k].sym==sym) return (int)k; return -1; }
+};
+static const size_t kMaxScopes=256;     // CALL's function id is one byte
 
 // ----------------- Parser
+// Hex (0x…, '_' separators allowed) or decimal literal; saturates on overflow.
+static uint64_t parse_number(std::string_view s){
+    unsigned base=10; if(s.size()>1 && s[0]=='0' && (s[1]=='x'||s[1]=='X')){ base=16; s.remove_prefix(2); }
+    uint64_t v=0;
+    for(char c:s){
+        if(c=='_') continue;
+        unsigned d = (c<='9')? unsigned(c-'0') : unsigned((c|0x20)-'a'+10);
+        if(v > (UINT64_MAX-d)/base) return UINT64_MAX;
+        v=v*base+d;
+    }
+    return v;
+}
+
 struct Parser{
-    Lexer& L; explicit Parser(Lexer& l):L(l){}
+    Lexer& L; Ast ast;
+    // `arena`: node storage of an earlier module to reuse (build workers)
+    explicit Parser(Lexer& l,Ast arena={}):L(l),ast(std::move(arena)){ ast.reset(); }
+    std::vector<uint32_t> scratch;      // ids of the lists being built, innermost last
+
+    // bare word such as `and` or a pragma (lexed as an identifier)
+    bool accept_word(const char* w){
+        if(L.peek().t!=Tok::Ident) return false;
+        auto t=L.text(L.peek()); size_t n=std::strlen(w);
+        if(t.size()!=n) return false;
+        for(size_t k=0;k<n;k++) if(std::tolower((unsigned char)t[k])!=w[k]) return false;
+        L.pop(); return true;
+    }
+    // turn scratch[mark..) into a list and pop it
+    uint32_t take_list(size_t mark){
+        uint32_t at=ast.push_list(scratch.data()+mark,scratch.size()-mark);
+        scratch.resize(mark); return at;
+    }
     Module parseModule(){
         L.expect(Tok::KwModule,"module");
         auto id=L.pop(); if(id.t!=Tok::Ident) throw std::runtime_error("module: expected name");
+        Module m; m.name=lowerc(L.text(id));
         L.expect(Tok::Colon,":");
-        Module m; m.name=lowerc(id.s);
-        m.mainFn=parseScope();
+        do{
+            Func f=parseScope();
+            if(m.find(f.sym)>=0) throw std::runtime_error("scope '"+f.name+"' defined twice (line "+std::to_string(f.line)+")");
+            m.funcs.push_back(std::move(f));
+        } while(L.peek().t==Tok::KwScope);
+        if(m.funcs.size()>kMaxScopes) throw std::runtime_error("too many scopes (max "+std::to_string(kMaxScopes)+")");
+        // the entry goes first: its code starts at offset 0
+        int entry=m.find(gSyms.intern("main"));
+        if(entry<0) throw std::runtime_error("module has no 'scope main'");
+        std::rotate(m.funcs.begin(),m.funcs.begin()+entry,m.funcs.begin()+entry+1);
+        m.ast=std::move(ast);
         return m;
     }
     Func parseScope(){
         L.expect(Tok::KwScope,"scope"); auto id=L.pop();
-        if(id.t!=Tok::Ident || lowerc(id.s)!="main") throw std::runtime_error("only 'scope main' supported");
+        if(id.t!=Tok::Ident) throw std::runtime_error("scope: expected name");
+        Func f; f.name=lowerc(L.text(id)); f.sym=gSyms.intern(L.text(id)); f.line=id.line;
+        if(SymbolTable::intrinsic(f.sym)!=Intrinsic::None) throw std::runtime_error("scope '"+f.name+"' shadows a built-in");
+        if(L.accept(Tok::LParen)){
+            if(L.peek().t!=Tok::RParen) do{
+                Stmt::EType et=Stmt::T_Implicit;
+                if(L.accept(Tok::KwInt)) et=Stmt::T_Int;
+                else if(L.accept(Tok::KwArr)) et=Stmt::T_Arr;
+                auto p=L.pop(); if(p.t!=Tok::Ident) throw std::runtime_error("scope "+f.name+": expected parameter name");
+                uint32_t sym=gSyms.intern(L.text(p));
+                for(auto& q:f.params) if(q.sym==sym) throw std::runtime_error("scope "+f.name+": parameter '"+gSyms.name(sym)+"' repeated");
+                f.params.push_back({sym,et,p.line});
+            } while(L.accept(Tok::Comma));
+            L.expect(Tok::RParen,")");
+        }
+        if(f.name=="main" && !f.params.empty()) throw std::runtime_error("scope main takes no parameters");
         L.expect(Tok::KwRange,"range"); auto r=L.pop(); if(r.t!=Tok::Ident) throw std::runtime_error("range: expected name");
         L.expect(Tok::Colon,":");
-        Func f; f.name="main"; f.line=id.line;
-        while(L.peek().t!=Tok::KwEnd && L.peek().t!=Tok::End){ f.body.push_back(parseStmt()); }
+        size_t mark=scratch.size();
+        while(L.peek().t!=Tok::KwEnd && L.peek().t!=Tok::End){
+            if(accept_word("swear_by_frame_jit")){ f.frameJit=true; continue; }   // assertion pragma, recorded in metadata
+            NodeId s=parseStmt(); scratch.push_back(s);
+        }
+        f.body=take_list(mark);
         L.expect(Tok::KwEnd,"end"); return f;
     }
-    Stmt parseStmt(){
+    NodeId parseStmt(){
         if(L.peek().t==Tok::KwLet){
             auto letTok=L.pop(); Stmt::EType et=Stmt::T_Implicit;
             if(L.accept(Tok::KwInt)) et=Stmt::T_Int;
             else if(L.accept(Tok::KwArr)) et=Stmt::T_Arr;
             auto id=L.pop(); if(id.t!=Tok::Ident) throw std::runtime_error("let: expected name");
+            uint32_t sym=gSyms.intern(L.text(id));
             L.expect(Tok::Equals,"=");
-            auto e=parseExpr();
-            return Stmt::makeLet(id.s,et,std::move(e),letTok.line);
+            NodeId e=parseExpr();
+            return ast.makeLet(sym,et,e,letTok.line);
         }
         if(L.peek().t==Tok::KwReturn){
-            auto rt=L.pop(); auto e=parseExpr(); return Stmt::makeRet(std::move(e),rt.line);
+            auto rt=L.pop(); NodeId e=parseExpr(); return ast.makeRet(e,rt.line);
         }
         if(L.peek().t==Tok::KwIf){
-            auto it=L.pop(); L.expect(Tok::LParen,"("); auto c=parseExpr(); L.expect(Tok::RParen,")"); L.expect(Tok::Colon,":");
-            std::vector<Stmt> thenB, elseB;
-            while(L.peek().t!=Tok::KwElse && L.peek().t!=Tok::KwEnd && L.peek().t!=Tok::End){ thenB.push_back(parseStmt()); }
+            auto it=L.pop(); L.expect(Tok::LParen,"("); NodeId c=parseExpr(); L.expect(Tok::RParen,")"); L.expect(Tok::Colon,":");
+            size_t thenMark=scratch.size();
+            while(L.peek().t!=Tok::KwElse && L.peek().t!=Tok::KwEnd && L.peek().t!=Tok::End){ NodeId s=parseStmt(); scratch.push_back(s); }
+            size_t elseMark=scratch.size();
             if(L.accept(Tok::KwElse)){
                 L.expect(Tok::Colon,":");
-                while(L.peek().t!=Tok::KwEnd && L.peek().t!=Tok::End){ elseB.push_back(parseStmt()); }
+                while(L.peek().t!=Tok::KwEnd && L.peek().t!=Tok::End){ NodeId s=parseStmt(); scratch.push_back(s); }
             }
             L.expect(Tok::KwEnd,"end");
-            return Stmt::makeIf(std::move(c),std::move(thenB),std::move(elseB),it.line);
+            // then and else lists are stored back to back
+            uint32_t thenList=ast.push_list(scratch.data()+thenMark,elseMark-thenMark);
+            take_list(elseMark); scratch.resize(thenMark);
+            return ast.makeIf(c,thenList,it.line);
         }
         throw std::runtime_error("Unknown statement at line "+std::to_string(L.peek().line));
     }
     // expr := primary ('+' primary)*
-    std::unique_ptr<Expr> parseExpr(){
-        auto t=parsePrimary();
-        while(L.accept(Tok::Plus)){ auto r=parsePrimary(); t=Expr::add(std::move(t),std::move(r),r->line); }
+    NodeId parseExpr(){
+        NodeId t=parsePrimary();
+        while(L.accept(Tok::Plus)){ NodeId r=parsePrimary(); t=ast.add(t,r,ast.expr(r).line); }
         return t;
     }
-    std::unique_ptr<Expr> parsePrimary(){
+    NodeId parsePrimary(){
         auto tk=L.pop();
         if(tk.t==Tok::Number){
-            uint64_t v=0;
-            if(starts_with(tk.s,"0x")||starts_with(tk.s,"0X")){
-                auto s=tk.s.substr(2); s.erase(std::remove(s.begin(),s.end(),'_'),s.end());
-                std::stringstream ss; ss<<std::hex<<s; ss>>v;
-            } else { std::stringstream ss; ss<<tk.s; ss>>v; }
-            return Expr::num(v,tk.line);
+            uint64_t v=parse_number(L.text(tk));
+            return ast.num(v,tk.line);
         } else if(tk.t==Tok::Ident){
+            uint32_t sym=gSyms.intern(L.text(tk));
             if(L.accept(Tok::LParen)){
-                std::vector<std::unique_ptr<Expr>> args;
-                if(L.peek().t!=Tok::RParen){ args.push_back(parseExpr()); while(L.accept(Tok::Comma)) args.push_back(parseExpr()); }
+                size_t mark=scratch.size();
+                if(L.peek().t!=Tok::RParen){
+                    NodeId a=parseExpr(); scratch.push_back(a);
+                    while(L.accept(Tok::Comma)){ a=parseExpr(); scratch.push_back(a); }
+                }
                 L.expect(Tok::RParen,")");
-                return Expr::call(lowerc(tk.s),std::move(args),tk.line);
+                return ast.call(sym,take_list(mark),tk.line);
+            }
+            Intrinsic fn=SymbolTable::intrinsic(sym);
+            if(fn==Intrinsic::Max||fn==Intrinsic::Min){
+                // superlative form: max A and B (from `greatest_of A and B`)
+                size_t mark=scratch.size();
+                NodeId a=parsePrimary(); scratch.push_back(a);
+                if(!accept_word("and")) throw std::runtime_error("expected 'and' at line "+std::to_string(L.peek().line));
+                a=parsePrimary(); scratch.push_back(a);
+                return ast.call(sym,take_list(mark),tk.line);
             }
-            return Expr::var(lowerc(tk.s),tk.line);
+            return ast.var(sym,tk.line);
         } else if(tk.t==Tok::LParen){
-            auto e=parseExpr(); L.expect(Tok::RParen,")"); return e;
+            NodeId e=parseExpr(); L.expect(Tok::RParen,")"); return e;
         }
         throw std::runtime_error("Expected primary at line "+std::to_string(tk.line));
     }
@@ -249,92 +839,957 @@ struct Parser{
 
 // ----------------- Types / Locals / Warnings
 struct Type{ enum K{ Int, Arr } k; };
-struct Local{ string name; Type ty; int index; int declLine; bool explicitDeclared=false; };
+struct Local{ uint32_t sym; Type ty; int index; int declLine; bool explicitDeclared=false; };
 
 struct Typer{
-    std::unordered_map<string,Local> locals;
-    int nextIdx=0;
+    std::vector<Local> locals;          // by slot index
+    std::vector<int32_t> slotOf;        // symbol id -> slot index, -1 if undeclared
     struct Warning{ string code,msg; int line; };
     std::vector<Warning> warns;
 
-    void declare_local(const string& n, int line, bool explicitType, Type::K k){
-        if(!locals.count(n)){
-            locals[n]=Local{n,Type{k},nextIdx++,line,explicitType};
-            if(!explicitType){
-                warns.push_back({"W001",(k==Type::Int? "implicit integer":"implicit array")+" type inferred for '"+n+"'",line});
-            }
+    int slot(uint32_t sym) const { return sym<slotOf.size()? slotOf[sym] : -1; }
+    int localIndex(uint32_t sym) const {
+        int i=slot(sym); if(i<0) throw std::runtime_error("use of undeclared "+gSyms.name(sym));
+        return i;
+    }
+    void declare_local(uint32_t sym, int line, bool explicitType, Type::K k){
+        if(slot(sym)>=0) return;
+        if(sym>=slotOf.size()) slotOf.resize(std::max<size_t>(gSyms.size(),sym+1),-1);
+        slotOf[sym]=(int32_t)locals.size();
+        locals.push_back(Local{sym,Type{k},(int)locals.size(),line,explicitType});
+        if(!explicitType){
+            warns.push_back({"W001",string(k==Type::Int? "implicit integer":"implicit array")+" type inferred for '"+gSyms.name(sym)+"'",line});
+        }
+    }
+    static bool cmp_fold(Intrinsic fn, int64_t A, int64_t B){      // signed, as the VM compares
+        switch(fn){
+            case Intrinsic::Gt: return A>B;  case Intrinsic::Lt: return A<B;
+            case Intrinsic::Ge: return A>=B; case Intrinsic::Le: return A<=B;
+            case Intrinsic::Eq: return A==B; default: return A!=B;
+        }
+    }
+    // rudimentary inference for implicit lets: arr if top-level call is arr_*
+    static Type::K infer_type(const Expr& e){
+        if(e.kind==Expr::Call){
+            if(e.fn==Intrinsic::ArrNew||e.fn==Intrinsic::ArrSet||e.fn==Intrinsic::ArrOf) return Type::Arr;
         }
+        return Type::Int;
     }
-    bool is_const_expr(const Expr* e, uint64_t& out) const{
-        switch(e->kind){
-            case Expr::Num: out=e->val; return true;
-            case Expr::Var: return false;
-            case Expr::Add:{ uint64_t A,B; if(is_const_expr(e->a.get(),A)&&is_const_expr(e->b.get(),B)){ out=A+B; return true;} return false; }
+};
+
+// ----------------- Constant folding
+// One bottom-up pass per function: each expression node is annotated exactly
+// once with its constant value, if it has one, and the value of every local is
+// tracked statement by statement so uses of constant-valued locals fold too.
+// Both arms of an `if` are folded from the same entry state and then merged: a
+// local stays constant only if every arm that can run leaves it with the same
+// value. Unvisited or non-constant nodes read as unknown.
+struct ConstFolds{
+    std::vector<uint8_t> known;         // by expr NodeId
+    std::vector<uint64_t> val;
+    bool get(NodeId e, uint64_t& out) const { if(!known[e]) return false; out=val[e]; return true; }
+};
+
+struct ConstFolder{
+    struct Val{ bool known=false; uint64_t v=0; bool operator==(const Val& o) const { return known==o.known && (!known || v==o.v); } };
+    using Writes=std::unordered_map<uint32_t,Val>;     // local -> value at the end of an arm
+    const Ast& A; ConstFolds& F;
+    std::vector<Val> env;                               // by symbol id
+    std::vector<std::pair<uint32_t,Val>> trail;         // (sym, previous value), for rolling back an arm
+
+    ConstFolder(const Ast& a, ConstFolds& f):A(a),F(f){
+        F.known.assign(A.exprs.size(),0); F.val.assign(A.exprs.size(),0);
+        env.resize(gSyms.size());
+    }
+    void run(const Func& f){ for(NodeId s:A.list(f.body)) fold_stmt(s); }
+
+    bool fold_expr(NodeId id, uint64_t& out){
+        const Expr& e=A.expr(id); bool k=false; uint64_t v=0;
+        switch(e.kind){
+            case Expr::Num: k=true; v=e.value(); break;
+            case Expr::Var: if(env[e.sym()].known){ k=true; v=env[e.sym()].v; } break;
+            case Expr::Add:{ uint64_t X=0,Y=0; bool kx=fold_expr(e.lhs(),X), ky=fold_expr(e.rhs(),Y); if(kx&&ky){ k=true; v=X+Y; } } break;
             case Expr::Call:{
-                auto nm=e->name;
-                if((nm=="max"||nm=="min") && e->args.size()==2){ uint64_t A,B; if(is_const_expr(e->args[0].get(),A)&&is_const_expr(e->args[1].get(),B)){ out=(nm=="max")? (std::max<uint64_t>(A,B)):(std::min<uint64_t>(A,B)); return true; } return false; }
-                if(nm=="ever_exact" && e->args.size()==1){ uint64_t X; if(is_const_expr(e->args[0].get(),X)){ out=X; return true;} return false; }
-                if(nm=="utterly_inline" && e->args.size()==1){ uint64_t X; if(is_const_expr(e->args[0].get(),X)){ out=X; return true;} return false; }
-                if((nm=="gt"||nm=="lt"||nm=="ge"||nm=="le"||nm=="eq"||nm=="ne") && e->args.size()==2){
-                    uint64_t A,B; if(is_const_expr(e->args[0].get(),A)&&is_const_expr(e->args[1].get(),B)){
-                        bool v=false;
-                        if(nm=="gt") v=(A>B); else if(nm=="lt") v=(A<B);
-                        else if(nm=="ge") v=(A>=B); else if(nm=="le") v=(A<=B);
-                        else if(nm=="eq") v=(A==B); else if(nm=="ne") v=(A!=B);
-                        out=v?1:0; return true;
-                    }
+                auto args=A.args(e); uint64_t X[2]={0,0}; bool all=true;
+                for(uint32_t i=0;i<args.size();++i){ uint64_t x=0; all&=fold_expr(args[i],x); if(i<2) X[i]=x; }
+                if(!all) break;
+                switch(e.fn){
+                    case Intrinsic::Max: case Intrinsic::Min:
+                        if(args.size()==2){ k=true; v=(uint64_t)((e.fn==Intrinsic::Max)? std::max((int64_t)X[0],(int64_t)X[1]) : std::min((int64_t)X[0],(int64_t)X[1])); } break;
+                    case Intrinsic::EverExact: case Intrinsic::UtterlyInline:
+                        if(args.size()==1){ k=true; v=X[0]; } break;
+                    case Intrinsic::Gt: case Intrinsic::Lt: case Intrinsic::Ge: case Intrinsic::Le: case Intrinsic::Eq: case Intrinsic::Ne:
+                        if(args.size()==2){ k=true; v=Typer::cmp_fold(e.fn,(int64_t)X[0],(int64_t)X[1])?1:0; } break;
+                    default: break;
                 }
-                return false;
+            } break;
+        }
+        F.known[id]=k; F.val[id]=v; out=v; return k;
+    }
+
+    void set_local(uint32_t sym, Val v){ trail.push_back({sym,env[sym]}); env[sym]=v; }
+
+    // fold one arm, then roll its writes back; returns the locals it wrote
+    Writes fold_arm(Ast::List body){
+        size_t mark=trail.size();
+        for(NodeId s:body) fold_stmt(s);
+        Writes w;
+        for(size_t k=mark;k<trail.size();++k) w[trail[k].first]=env[trail[k].first];
+        while(trail.size()>mark){ env[trail.back().first]=trail.back().second; trail.pop_back(); }
+        return w;
+    }
+
+    void fold_stmt(NodeId id){
+        const Stmt& s=A.stmt(id);
+        switch(s.kind){
+            case Stmt::Let:{ uint64_t v=0; bool k=fold_expr(s.expr(),v); set_local(s.sym(),Val{k,v}); } break;
+            case Stmt::Ret:{ uint64_t v=0; fold_expr(s.expr(),v); } break;
+            case Stmt::If:{
+                uint64_t c=0; bool ck=fold_expr(s.cond(),c);
+                Writes tw=fold_arm(A.then_body(s)), ew=fold_arm(A.else_body(s));
+                if(ck){ for(auto& w:(c? tw:ew)) set_local(w.first,w.second); break; }   // only one arm runs
+                for(auto& w:tw){
+                    auto it=ew.find(w.first); Val other= it!=ew.end()? it->second : env[w.first];
+                    set_local(w.first, w.second==other? w.second : Val{});
+                }
+                for(auto& w:ew) if(!tw.count(w.first)) set_local(w.first, w.second==env[w.first]? w.second : Val{});
+            } break;
+        }
+    }
+};
+
+// ----------------- Compile-time evaluation (ever_exact)
+// Runs a function at build time with the VM's semantics: int64 values,
+// wrapping adds, signed compares, 1-based array handles, out-of-range reads
+// give 0 and out-of-range writes are ignored. The language has no inputs, so
+// whatever runs here runs identically at run time, and every node runs at most
+// once. Only the entry scope is evaluated: a scope with parameters has inputs.
+// Calls run the callee with a fresh environment, up to kCtEvalDepth deep. The
+// value of each ever_exact reached in the entry scope itself is recorded unless
+// its argument touched the heap (arr_new/arr_of/arr_set), since dropping that
+// code would be visible later. Each node evaluated and each array cell
+// allocated costs one step, and a call one step per symbol it saves; once the
+// budget is spent evaluation stops and the ever_exact nodes not yet reached
+// compile normally.
+static const uint64_t kCtEvalSteps=1000000;
+static const uint32_t kCtEvalDepth=256;
+
+struct CtEval{
+    const Module& M; const Ast& A; const uint64_t budget; uint64_t steps=0; uint32_t depth=0;
+    std::vector<int64_t> env;                       // by symbol id; unassigned locals read 0, as in the VM
+    std::vector<std::vector<int64_t>> arrays;
+    uint64_t heapWrites=0;                          // allocations + stores so far
+    std::unordered_map<NodeId,int64_t> exact;       // ever_exact node -> its value
+    bool returned=false, exhausted=false; NodeId retStmt=0; int64_t result=0;
+    struct Stop{ bool budget; };
+
+    CtEval(const Module& m, uint64_t b):M(m),A(m.ast),budget(b),env(gSyms.size(),0){}
+    void run(const Func& f){
+        try{ returned=exec(A.list(f.body)); }
+        catch(const Stop& s){ exhausted=s.budget; }
+    }
+    void tick(uint64_t n=1){ if(n>budget-steps) throw Stop{true}; steps+=n; }
+
+    int64_t eval(NodeId id){
+        tick(); const Expr& e=A.expr(id);
+        switch(e.kind){
+            case Expr::Num: return (int64_t)e.value();
+            case Expr::Var: return env[e.sym()];
+            case Expr::Add:{ int64_t x=eval(e.lhs()), y=eval(e.rhs()); return (int64_t)((uint64_t)x+(uint64_t)y); }
+            case Expr::Call: break;
+        }
+        auto args=A.args(e);
+        auto need=[&](uint32_t n){ if(args.size()!=n) throw Stop{false}; };   // the emitter reports the error
+        switch(e.fn){
+            case Intrinsic::Max: case Intrinsic::Min:{
+                need(2); int64_t x=eval(args[0]), y=eval(args[1]);
+                return e.fn==Intrinsic::Max? std::max(x,y) : std::min(x,y);
+            }
+            case Intrinsic::EverExact:{
+                need(1); uint64_t w=heapWrites; int64_t v=eval(args[0]);
+                if(heapWrites==w && depth==0) exact[id]=v;
+                return v;
+            }
+            case Intrinsic::UtterlyInline: need(1); return eval(args[0]);
+            case Intrinsic::Gt: case Intrinsic::Lt: case Intrinsic::Ge: case Intrinsic::Le: case Intrinsic::Eq: case Intrinsic::Ne:{
+                need(2); int64_t x=eval(args[0]), y=eval(args[1]);
+                switch(e.fn){
+                    case Intrinsic::Gt: return x>y;  case Intrinsic::Lt: return x<y;
+                    case Intrinsic::Ge: return x>=y; case Intrinsic::Le: return x<=y;
+                    case Intrinsic::Eq: return x==y; default: return x!=y;
+                }
+            }
+            case Intrinsic::ArrNew:{ need(1); int64_t len=eval(args[0]); return alloc(len<0? 0:(uint64_t)len); }
+            case Intrinsic::ArrGet:{
+                need(2); int64_t h=eval(args[0]), i=eval(args[1]);
+                auto* a=array(h); return a && i>=0 && (uint64_t)i<a->size()? (*a)[(size_t)i] : 0;
+            }
+            case Intrinsic::ArrSet:{
+                need(3); int64_t h=eval(args[0]), i=eval(args[1]), v=eval(args[2]);
+                ++heapWrites; auto* a=array(h); if(a && i>=0 && (uint64_t)i<a->size()) (*a)[(size_t)i]=v;
+                return h;
+            }
+            case Intrinsic::ArrOf:{
+                // same order as the emitted code: allocate, then evaluate and store each element
+                int64_t h=alloc(args.size());
+                for(uint32_t i=0;i<args.size();++i){ int64_t v=eval(args[i]); ++heapWrites; (*array(h))[i]=v; }
+                return h;
+            }
+            case Intrinsic::None: return call(e);
+            default: throw Stop{false};
+        }
+    }
+    int64_t call(const Expr& e){
+        int k=M.find(e.sym()); auto args=A.args(e);
+        if(k<0 || args.size()!=M.funcs[(size_t)k].params.size() || depth>=kCtEvalDepth) throw Stop{false};
+        const Func& g=M.funcs[(size_t)k];
+        std::vector<int64_t> in(args.size());
+        for(uint32_t i=0;i<args.size();++i) in[i]=eval(args[i]);
+        tick(env.size());
+        std::vector<int64_t> saved(env.size(),0); std::swap(env,saved);
+        for(size_t i=0;i<in.size();++i) env[g.params[i].sym]=in[i];
+        int64_t r=result; NodeId rs=retStmt; ++depth;
+        int64_t v= exec(A.list(g.body))? result : 0;   // falling off the end returns 0
+        --depth; result=r; retStmt=rs; std::swap(env,saved);
+        return v;
+    }
+    int64_t alloc(uint64_t len){ tick(len); ++heapWrites; arrays.emplace_back((size_t)len,0); return (int64_t)arrays.size(); }
+    std::vector<int64_t>* array(int64_t h){ return h>0 && (uint64_t)h<=arrays.size()? &arrays[(size_t)h-1] : nullptr; }
+
+    // true once a `return` has run
+    bool exec(Ast::List body){
+        for(NodeId id:body){
+            tick(); const Stmt& s=A.stmt(id);
+            switch(s.kind){
+                case Stmt::Let: env[s.sym()]=eval(s.expr()); break;
+                case Stmt::Ret: result=eval(s.expr()); retStmt=id; return true;
+                case Stmt::If: if(exec(eval(s.cond())!=0? A.then_body(s) : A.else_body(s))) return true; break;
             }
         }
         return false;
     }
+};
 
-    // rudimentary inference for implicit lets: arr if top-level call is arr_*
-    Type::K infer_type(const Expr* e){
-        if(e->kind==Expr::Call){
-            if(e->name=="arr_new"||e->name=="arr_set"||e->name=="arr_of") return Type::Arr;
+// ----------------- SSA middle end
+// Built per function after constant folding, over exactly the code the
+// emitter will produce: folded subtrees, evaluated ever_exact calls, dead arms
+// and statements after `return` are skipped. Every `let` defines a new value,
+// an `if` join gets a phi for each local its live arms leave different, and a
+// local read before any assignment is the undefined value (0, as in the VM).
+// A parameter is a value defined on entry and keeps the slot its argument
+// arrives in. Statements are numbered in emission order; with no loops, a value is live
+// from its definition to its last use in that order, except in the arms of an
+// if it is not read in when it is not read after the if either.
+//   copy propagation  a read of x after `let x = y` reads y's value when no
+//                     definition of y lies between the copy and the read
+//   value numbering   a pure subexpression equal to the value of an earlier
+//                     `let` (or phi) still in scope loads that value instead;
+//                     arr_get keys on the version of the memory it reads, so
+//                     only an arr_set that may hit the same array splits it
+//   dead stores       a `let` nobody reads is not emitted, unless its
+//                     expression allocates or writes arrays or calls a scope
+//   slots             a phi and its operands (a web) share one slot; webs
+//                     whose live segments do not overlap share slots, so
+//                     names local to disjoint then/else arms share too
+struct SsaSlots{
+    std::vector<int32_t> load;          // Var expr -> slot; -1: undefined, reads 0
+    std::vector<int32_t> store;         // Let stmt -> slot; -1: dead, not emitted
+    std::vector<uint8_t> reuse;         // expr -> 1: its value is already in slot load[expr]
+    std::vector<uint32_t> entryZero;    // slots read as 0 before any write on some path
+    struct Def{ uint32_t sym, line; int32_t slot; };
+    std::vector<Def> map;               // emitted lets in emission order (meta "slot_map")
+    uint32_t nSlots=0, values=0, copies=0, cse=0, deadStores=0;
+};
+
+class SsaBuilder{
+    static constexpr uint32_t kNone=UINT32_MAX;
+    struct Value{
+        enum Kind : uint8_t { Undef, Let, Phi, Param } kind; uint32_t sym; uint32_t pos;
+        NodeId stmt=0; uint32_t copyOf=kNone, opA=kNone, opB=kNone;
+        uint32_t elseAt=0;                  // Phi: first position of the else arm
+        uint32_t usesBegin=0, usesEnd=0;    // Let: reads made by its expression
+        bool effect=false;
+        uint32_t vn=0;                      // value number
+    };
+    struct Use{ NodeId expr; uint32_t val; uint32_t pos; bool root, reuse=false, drop=false; };
+    // a pure expression whose value `val` already holds; taken in run() only
+    // if `val` is stored anyway, the reads [usesBegin, usesEnd) then go away
+    struct Reuse{ NodeId expr; uint32_t val, pos, usesBegin, usesEnd; };
+
+    const Ast& A; const ConstFolds& F; const std::unordered_map<NodeId,int64_t>& exact;
+    std::vector<Value> vals; std::vector<Use> uses;
+    std::vector<uint32_t> cur, undef;                   // by symbol id
+    std::vector<std::pair<uint32_t,uint32_t>> trail;    // (sym, previous value)
+    std::vector<std::vector<uint32_t>> defPos;          // by symbol id, ascending
+    struct IfRange{ uint32_t cond, elseAt, join; int32_t parent; };   // then arm: (cond, elseAt), else arm: [elseAt, join)
+    std::vector<IfRange> ifs;
+    std::vector<int32_t> encl{-1}, ifStack;             // by position: innermost if whose arms hold it
+    uint32_t pos=0, next=1;
+
+    uint32_t new_pos(){ encl.push_back(ifStack.empty()? -1 : ifStack.back()); return next++; }
+
+    // Value numbers: equal numbers are equal values at run time. Number 0 is
+    // unused; constants number by value, each array allocation is fresh.
+    enum VnOp : uint32_t { VN_CONST, VN_ADD, VN_MAX, VN_MIN, VN_LT, VN_LE, VN_EQ, VN_NE, VN_GET };
+    enum VnKind : uint8_t { VK_PLAIN, VK_CONST, VK_ARRAY };
+    struct VnKey{
+        uint32_t k[5];
+        bool operator==(const VnKey& o) const { return std::memcmp(k,o.k,sizeof k)==0; }
+    };
+    struct VnHash{ size_t operator()(const VnKey& x) const { uint64_t h=1469598103934665603ull; for(uint32_t w:x.k){ h^=w; h*=1099511628211ull; } return (size_t)h; } };
+    std::unordered_map<VnKey,uint32_t,VnHash> vnOf;
+    std::vector<uint8_t> vnKind{VK_PLAIN};
+    uint32_t vn_fresh(VnKind k=VK_PLAIN){ vnKind.push_back(k); return (uint32_t)vnKind.size()-1; }
+    uint32_t vn(VnOp op,uint32_t a,uint32_t b=0,uint32_t c=0,uint32_t d=0,VnKind k=VK_PLAIN){
+        auto it=vnOf.emplace(VnKey{{op,a,b,c,d}},0u);
+        if(it.second) it.first->second=vn_fresh(k);
+        return it.first->second;
+    }
+    uint32_t vn_const(uint64_t v){ return vn(VN_CONST,uint32_t(v),uint32_t(v>>32),0,0,VK_CONST); }
+
+    // Memory versions: one per allocation, one for writes through handles of
+    // unknown origin and one for all writes. Every bump is a new tick.
+    static constexpr uint32_t kClobber=UINT32_MAX-1, kAnyWrite=UINT32_MAX-2;
+    std::unordered_map<uint32_t,uint32_t> mem; uint32_t tick=0;
+    std::vector<std::pair<uint32_t,uint32_t>> memTrail;     // (key, previous version)
+    uint32_t ver(uint32_t key) const { auto it=mem.find(key); return it==mem.end()? 0 : it->second; }
+    void bump(uint32_t key){ memTrail.push_back({key,ver(key)}); mem[key]=++tick; }
+    // versions an arm bumped; rolls the arm back
+    std::vector<uint32_t> take_mem(size_t mark){
+        std::vector<uint32_t> keys;
+        while(memTrail.size()>mark){ keys.push_back(memTrail.back().first); mem[memTrail.back().first]=memTrail.back().second; memTrail.pop_back(); }
+        return keys;
+    }
+
+    std::unordered_map<uint32_t,uint32_t> avail;            // value number -> value in scope holding it
+    std::vector<std::pair<uint32_t,uint32_t>> availTrail;   // (number, previous value or kNone)
+    void make_avail(uint32_t vnum,uint32_t v){
+        if(vnKind[vnum]==VK_CONST) return;                  // an immediate is as cheap as a load
+        auto it=avail.find(vnum); availTrail.push_back({vnum,it==avail.end()? kNone : it->second}); avail[vnum]=v;
+    }
+    void drop_avail(size_t mark){
+        for(;availTrail.size()>mark;availTrail.pop_back()){
+            auto& t=availTrail.back();
+            if(t.second==kNone) avail.erase(t.first); else avail[t.first]=t.second;
         }
-        return Type::Int;
+    }
+
+    uint32_t make(Value v){ vals.push_back(v); return (uint32_t)vals.size()-1; }
+    uint32_t value_of(uint32_t sym){
+        if(cur[sym]!=kNone) return cur[sym];
+        if(undef[sym]==kNone){ Value u{Value::Undef,sym,0}; u.vn=vn_fresh(); undef[sym]=make(u); }
+        return undef[sym];
+    }
+    void define(uint32_t sym,uint32_t v,uint32_t at){ trail.push_back({sym,cur[sym]}); cur[sym]=v; defPos[sym].push_back(at); }
+    // locals an arm left changed, with their values at its end; rolls the arm back
+    std::vector<std::pair<uint32_t,uint32_t>> take_arm(size_t mark){
+        std::vector<std::pair<uint32_t,uint32_t>> w;
+        for(size_t k=mark;k<trail.size();++k) w.push_back({trail[k].first,0});
+        std::sort(w.begin(),w.end()); w.erase(std::unique(w.begin(),w.end()),w.end());
+        for(auto& e:w) e.second=cur[e.first];
+        while(trail.size()>mark){ cur[trail.back().first]=trail.back().second; trail.pop_back(); }
+        return w;
+    }
+
+    // Records the reads of the emitted code and returns its value number; sets
+    // fx if it allocates or writes arrays.
+    uint32_t walk_expr(NodeId id,bool& fx){
+        const Expr& e=A.expr(id); uint64_t cv;
+        if(e.kind!=Expr::Num && F.get(id,cv)) return vn_const(cv);
+        size_t mark=uses.size(); bool sub=false; uint32_t n=0;
+        switch(e.kind){
+            case Expr::Num: return vn_const(e.value());
+            case Expr::Var:{ uint32_t v=value_of(e.sym()); uses.push_back({id,v,pos,false}); return vals[v].vn; }
+            case Expr::Add:{
+                uint32_t a=walk_expr(e.lhs(),sub), b=walk_expr(e.rhs(),sub);
+                if(sub){ fx=true; return vn_fresh(); }
+                n=vn(VN_ADD,std::min(a,b),std::max(a,b));
+            } break;
+            case Expr::Call:{
+                auto ex=exact.find(id);
+                if(e.fn==Intrinsic::EverExact && ex!=exact.end()) return vn_const((uint64_t)ex->second);
+                auto args=A.args(e); uint32_t x[3]={0,0,0};
+                for(uint32_t i=0;i<args.size();++i){ uint32_t a=walk_expr(args[i],sub); if(i<3) x[i]=a; }
+                // an effect below: never reused, so never numbered
+                if(sub && e.fn!=Intrinsic::ArrSet && e.fn!=Intrinsic::ArrNew && e.fn!=Intrinsic::ArrOf && e.fn!=Intrinsic::None){ fx=true; return vn_fresh(); }
+                switch(e.fn){
+                    case Intrinsic::Max: n=vn(VN_MAX,std::min(x[0],x[1]),std::max(x[0],x[1])); break;
+                    case Intrinsic::Min: n=vn(VN_MIN,std::min(x[0],x[1]),std::max(x[0],x[1])); break;
+                    case Intrinsic::Gt: n=vn(VN_LT,x[1],x[0]); break;
+                    case Intrinsic::Lt: n=vn(VN_LT,x[0],x[1]); break;
+                    case Intrinsic::Ge: n=vn(VN_LE,x[1],x[0]); break;
+                    case Intrinsic::Le: n=vn(VN_LE,x[0],x[1]); break;
+                    case Intrinsic::Eq: n=vn(VN_EQ,std::min(x[0],x[1]),std::max(x[0],x[1])); break;
+                    case Intrinsic::Ne: n=vn(VN_NE,std::min(x[0],x[1]),std::max(x[0],x[1])); break;
+                    case Intrinsic::EverExact: case Intrinsic::UtterlyInline: n=x[0]; break;
+                    case Intrinsic::ArrGet:{
+                        bool own=vnKind[x[0]]==VK_ARRAY;
+                        n=vn(VN_GET,x[0],x[1],ver(own? x[0] : kAnyWrite),own? ver(kClobber) : 0);
+                    } break;
+                    case Intrinsic::ArrSet:
+                        bump(vnKind[x[0]]==VK_ARRAY? x[0] : kClobber); bump(kAnyWrite);
+                        fx=true; return x[0];
+                    case Intrinsic::ArrNew: case Intrinsic::ArrOf: fx=true; return vn_fresh(VK_ARRAY);
+                    case Intrinsic::None:   // a scope: may write any array it is handed
+                        bump(kClobber); bump(kAnyWrite);
+                        fx=true; return vn_fresh();
+                    default: return vn_fresh();   // the emitter reports it
+                }
+            } break;
+        }
+        // pure: a value in scope may already hold it. a+b of two leaves is a
+        // single ADD_LL/ADD_IMM, no dearer than the load
+        auto leaf=[&](NodeId x){ uint64_t c; Expr::Kind k=A.expr(x).kind; return k==Expr::Var || k==Expr::Num || F.get(x,c); };
+        auto it=avail.find(n);
+        if(it!=avail.end() && uses.size()>mark && !(e.kind==Expr::Add && leaf(e.lhs()) && leaf(e.rhs()))
+           && !def_between(vals[it->second].sym,vals[it->second].pos,pos))
+            reuses.push_back({id,it->second,pos,(uint32_t)mark,(uint32_t)uses.size()});
+        return n;
+    }
+    std::vector<Reuse> reuses;
+    void walk_root(NodeId e){ size_t b=uses.size(); bool fx=false; walk_expr(e,fx); for(size_t k=b;k<uses.size();++k) uses[k].root=true; }
+
+    // true when control cannot fall through, as in Emitter::gen_block
+    bool walk_block(Ast::List body){ for(NodeId id:body) if(walk_stmt(id)) return true; return false; }
+    bool walk_stmt(NodeId id){
+        const Stmt& s=A.stmt(id); pos=new_pos();
+        switch(s.kind){
+            case Stmt::Let:{
+                Value v{Value::Let,s.sym(),pos,id}; v.usesBegin=(uint32_t)uses.size();
+                bool fx=false; v.vn=walk_expr(s.expr(),fx); v.effect=fx; v.usesEnd=(uint32_t)uses.size();
+                if(v.usesEnd>v.usesBegin && uses.back().expr==s.expr()) v.copyOf=uses.back().val;   // let x = y
+                uint32_t val=make(v); define(s.sym(),val,pos);
+                if(!fx) make_avail(v.vn,val);
+            } return false;
+            case Stmt::Ret: walk_root(s.expr()); return true;
+            case Stmt::If:{
+                uint64_t c;
+                if(F.get(s.cond(),c)) return walk_block(c? A.then_body(s) : A.else_body(s));
+                walk_root(s.cond());
+                int32_t k=(int32_t)ifs.size(); ifs.push_back({pos,0,0,ifStack.empty()? -1 : ifStack.back()});
+                size_t mark=trail.size(), memMark=memTrail.size(), availMark=availTrail.size(); ifStack.push_back(k);
+                bool tRet=walk_block(A.then_body(s)); auto tw=take_arm(mark); auto tm=take_mem(memMark); drop_avail(availMark);
+                uint32_t elseAt=ifs[k].elseAt=next;
+                bool eRet=walk_block(A.else_body(s)); auto ew=take_arm(mark); auto em=take_mem(memMark); drop_avail(availMark);
+                ifStack.pop_back(); ifs[k].join=next;
+                if(tRet && eRet) return true;
+                // memory an arm wrote is in a new version after the join
+                tm.insert(tm.end(),em.begin(),em.end()); std::sort(tm.begin(),tm.end()); tm.erase(std::unique(tm.begin(),tm.end()),tm.end());
+                for(uint32_t key:tm) bump(key);
+                uint32_t join=new_pos();
+                std::vector<uint32_t> syms;
+                for(auto& w:tw) syms.push_back(w.first);
+                for(auto& w:ew) syms.push_back(w.first);
+                std::sort(syms.begin(),syms.end()); syms.erase(std::unique(syms.begin(),syms.end()),syms.end());
+                auto at=[&](const std::vector<std::pair<uint32_t,uint32_t>>& w,uint32_t sym){
+                    auto it=std::lower_bound(w.begin(),w.end(),std::make_pair(sym,0u));
+                    return it!=w.end() && it->first==sym? it->second : value_of(sym);
+                };
+                for(uint32_t sym:syms){
+                    uint32_t a=at(tw,sym), b=at(ew,sym);
+                    // one arm returns: the other arm's value flows on
+                    if(tRet || a==b){ if(b!=value_of(sym)) define(sym,b,join); continue; }
+                    if(eRet){ if(a!=value_of(sym)) define(sym,a,join); continue; }
+                    Value p{Value::Phi,sym,join}; p.opA=a; p.opB=b; p.elseAt=elseAt;
+                    p.vn= vals[a].vn==vals[b].vn? vals[a].vn : vn_fresh();
+                    uint32_t val=make(p); define(sym,val,join); make_avail(p.vn,val);
+                }
+            } return false;
+        }
+        return false;
+    }
+
+    bool def_between(uint32_t sym,uint32_t p,uint32_t q) const {
+        auto& d=defPos[sym]; auto it=std::upper_bound(d.begin(),d.end(),p);
+        return it!=d.end() && *it<q;
+    }
+    uint32_t find(std::vector<uint32_t>& up,uint32_t v){ while(up[v]!=v) v=up[v]=up[up[v]]; return v; }
+
+public:
+    SsaBuilder(const Ast& a,const ConstFolds& f,const std::unordered_map<NodeId,int64_t>& ex)
+        :A(a),F(f),exact(ex),cur(gSyms.size(),kNone),undef(gSyms.size(),kNone),defPos(gSyms.size()){}
+
+    SsaSlots run(const Func& f){
+        for(auto& p:f.params){ Value v{Value::Param,p.sym,0}; v.vn=vn_fresh(); undef[p.sym]=make(v); }
+        walk_block(A.list(f.body));
+        SsaSlots S; S.load.assign(A.exprs.size(),-1); S.store.assign(A.stmts.size(),-1); S.reuse.assign(A.exprs.size(),0);
+        S.values=(uint32_t)vals.size();
+
+        // copy propagation, one read at a time along the copy chain
+        auto propagate=[&](uint32_t v,uint32_t at){
+            while(vals[v].kind==Value::Let && vals[v].copyOf!=kNone && !def_between(vals[vals[v].copyOf].sym,vals[v].pos,at)) v=vals[v].copyOf;
+            return v;
+        };
+        auto copy_prop=[&]{ for(auto& u:uses) if(!u.drop){ uint32_t v=propagate(u.val,u.pos); if(v!=u.val){ u.val=v; ++S.copies; } } };
+
+        // liveness: from the reads in returns and conditions and the lets kept
+        // for their effects, through the lets and phis that feed them
+        std::vector<uint8_t> live, emitted;
+        std::vector<uint32_t> work;
+        auto mark=[&](uint32_t v){ if(!live[v]){ live[v]=1; work.push_back(v); } };
+        auto emit_let=[&](uint32_t v){ if(!emitted[v]){ emitted[v]=1; for(uint32_t k=vals[v].usesBegin;k<vals[v].usesEnd;++k) if(!uses[k].drop) mark(uses[k].val); } };
+        auto liveness=[&]{
+            live.assign(vals.size(),0); emitted.assign(vals.size(),0);
+            for(auto& u:uses) if(u.root && !u.drop) mark(u.val);
+            for(uint32_t v=0;v<vals.size();++v) if(vals[v].kind==Value::Let && vals[v].effect) emit_let(v);
+            while(!work.empty()){
+                uint32_t v=work.back(); work.pop_back();
+                if(vals[v].kind==Value::Let) emit_let(v);
+                else if(vals[v].kind==Value::Phi){ mark(vals[v].opA); mark(vals[v].opB); }
+            }
+        };
+        copy_prop(); liveness();
+
+        // value numbering: outermost first, load a value that is stored anyway
+        // in place of recomputing it; the first read stands for the whole
+        // expression, the rest are dropped. An undefined value has no slot
+        // unless a phi merges it, so an expression equal to one is recomputed.
+        for(size_t r=reuses.size();r-->0;){
+            Reuse& x=reuses[r]; uint32_t v=propagate(x.val,x.pos);
+            Use& head=uses[x.usesBegin];
+            if(!live[v] || vals[v].kind==Value::Undef || head.drop || head.reuse) continue;
+            for(uint32_t k=x.usesBegin+1;k<x.usesEnd;++k) uses[k].drop=true;
+            head={x.expr,v,x.pos,head.root,true};
+            S.reuse[x.expr]=1; ++S.cse;
+        }
+        // a let that is all reuse is a copy
+        for(auto& l:vals)
+            if(l.kind==Value::Let && l.usesEnd>l.usesBegin && uses[l.usesBegin].reuse && uses[l.usesBegin].expr==A.stmt(l.stmt).expr()) l.copyOf=uses[l.usesBegin].val;
+        copy_prop(); liveness();
+
+        // Live segments, in points: statement p reads at 2p and writes at
+        // 2p+1, a phi is written at 2*join, and a phi operand is read at the end
+        // of the arm it comes from. A value is live from its write to its last
+        // read, minus every arm of an if enclosing that last read that does not
+        // read it: on the way through that arm the value is dead.
+        auto defPt=[&](uint32_t v){ const Value& x=vals[v]; return x.kind==Value::Undef || x.kind==Value::Param? 0u : x.kind==Value::Phi? 2*x.pos : 2*x.pos+1; };
+        std::vector<std::pair<uint32_t,uint32_t>> reads;                      // (value, point)
+        for(uint32_t v=0;v<vals.size();++v){
+            if(vals[v].kind==Value::Let && emitted[v]) for(uint32_t k=vals[v].usesBegin;k<vals[v].usesEnd;++k) if(!uses[k].drop) reads.push_back({uses[k].val,2*vals[v].pos});
+            if(vals[v].kind==Value::Phi && live[v]){ reads.push_back({vals[v].opA,2*vals[v].elseAt-1}); reads.push_back({vals[v].opB,2*vals[v].pos-1}); }
+        }
+        for(auto& u:uses) if(u.root && !u.drop) reads.push_back({u.val,2*u.pos});
+        std::sort(reads.begin(),reads.end());
+        auto readsOf=[&](uint32_t v){
+            auto lo=std::lower_bound(reads.begin(),reads.end(),std::make_pair(v,0u));
+            auto hi=std::lower_bound(lo,reads.end(),std::make_pair(v+1,0u));
+            return std::make_pair(lo,hi);
+        };
+        using Seg=std::pair<uint32_t,uint32_t>;                                // [from, to)
+        auto segments=[&](uint32_t v){
+            auto r=readsOf(v); uint32_t s0=defPt(v), e0= r.first==r.second? s0+1 : (r.second-1)->second+1;
+            std::vector<Seg> holes;
+            auto readIn=[&](uint32_t a,uint32_t b){ auto it=std::lower_bound(r.first,r.second,std::make_pair(v,a)); return it!=r.second && it->second<b; };
+            for(int32_t k=encl[(e0-1)/2]; k>=0 && 2*ifs[k].cond>=s0; k=ifs[k].parent){
+                const IfRange& I=ifs[k];
+                Seg thenArm{2*I.cond+2,2*I.elseAt}, elseArm{2*I.elseAt,2*I.join};
+                if(thenArm.first<thenArm.second && !readIn(thenArm.first,thenArm.second)) holes.push_back(thenArm);
+                if(elseArm.first<elseArm.second && !readIn(elseArm.first,elseArm.second)) holes.push_back(elseArm);
+            }
+            std::sort(holes.begin(),holes.end());
+            std::vector<Seg> out; uint32_t at=s0;
+            for(auto& h:holes){ if(h.first>=e0) break; if(h.first>at) out.push_back({at,h.first}); at=std::max(at,h.second); }
+            if(at<e0) out.push_back({at,e0});
+            return out;
+        };
+
+        // webs: a live phi and its operands share a slot
+        std::vector<uint32_t> up(vals.size());
+        for(uint32_t v=0;v<vals.size();++v) up[v]=v;
+        for(uint32_t v=0;v<vals.size();++v)
+            if(vals[v].kind==Value::Phi && live[v]) for(uint32_t o:{vals[v].opA,vals[v].opB}) up[find(up,o)]=find(up,v);
+        struct Web{ std::vector<Seg> segs; int32_t slot=-1; bool needed=false; };
+        std::vector<Web> webs(vals.size());
+        for(uint32_t v=0;v<vals.size();++v){
+            // an undefined value only needs a slot when a phi merges it
+            bool slotted= vals[v].kind==Value::Let? emitted[v] : live[v] && (vals[v].kind!=Value::Undef || find(up,v)!=v);
+            if(!slotted) continue;
+            Web& w=webs[find(up,v)]; w.needed=true;
+            auto sg=segments(v); w.segs.insert(w.segs.end(),sg.begin(),sg.end());
+        }
+        std::vector<uint32_t> order;
+        for(uint32_t r=0;r<webs.size();++r){
+            Web& w=webs[r]; if(!w.needed) continue;
+            std::sort(w.segs.begin(),w.segs.end());
+            size_t n=0;
+            for(auto& sg:w.segs){ if(n && sg.first<=w.segs[n-1].second) w.segs[n-1].second=std::max(w.segs[n-1].second,sg.second); else w.segs[n++]=sg; }
+            w.segs.resize(n); order.push_back(r);
+        }
+        // a parameter's web stays in the slot its argument arrives in
+        const uint32_t nParams=(uint32_t)f.params.size();
+        std::vector<int32_t> pin(vals.size(),-1);
+        for(uint32_t k=0;k<nParams;++k) pin[find(up,undef[f.params[k].sym])]=(int32_t)k;
+        // a web holding an undefined value reads 0 on entry, so it must not
+        // land in an argument slot: CALL has written the argument there
+        std::vector<uint8_t> zero(vals.size(),0);
+        for(uint32_t v=0;v<vals.size();++v) if(vals[v].kind==Value::Undef) zero[find(up,v)]=1;
+
+        // First fit in start order: a slot whose webs have all ended, else one
+        // whose live webs leave a hole covering this web. Greedy is optimal for
+        // plain intervals but not with holes, so the hull-only assignment is
+        // kept when it needs fewer slots. Parameter webs start at 0 and go
+        // first; the argument slots are free until then, except to webs that
+        // must read 0 on entry.
+        std::sort(order.begin(),order.end(),[&](uint32_t a,uint32_t b){
+            if(webs[a].segs[0].first!=webs[b].segs[0].first) return webs[a].segs[0].first<webs[b].segs[0].first;
+            return (pin[a]<0)!=(pin[b]<0)? pin[a]>=0 : a<b;
+        });
+        auto fits=[&](const std::map<uint32_t,uint32_t>& occ,const std::vector<Seg>& segs){
+            for(auto& sg:segs){
+                auto it=occ.lower_bound(sg.second);
+                if(it!=occ.begin() && std::prev(it)->second>sg.first) return false;
+            }
+            return true;
+        };
+        auto color=[&](bool holes,std::vector<int32_t>& slotOf){
+            std::vector<std::map<uint32_t,uint32_t>> occupied(nParams);        // by slot: from -> to
+            std::vector<int32_t> active;                                      // slots still in use at the current start
+            std::set<int32_t> freeSlots;                                      // lowest first
+            for(uint32_t k=0;k<nParams;++k) freeSlots.insert((int32_t)k);
+            std::vector<Seg> hull(1);
+            for(uint32_t r:order){
+                const Web& w=webs[r]; uint32_t from=w.segs[0].first;
+                hull[0]={from,w.segs.back().second};
+                const std::vector<Seg>& segs= holes? w.segs : hull;
+                for(size_t k=0;k<active.size();)
+                    if(occupied[active[k]].rbegin()->second<=from){ freeSlots.insert(active[k]); active[k]=active.back(); active.pop_back(); } else ++k;
+                const int32_t lo= zero[r]? (int32_t)nParams : 0;
+                auto fr=freeSlots.lower_bound(lo);
+                int32_t slot= pin[r]>=0? pin[r] : fr==freeSlots.end()? INT32_MAX : *fr;
+                if(holes && slot==INT32_MAX) for(int32_t a:active) if(a>=lo && a<slot && fits(occupied[a],segs)) slot=a;
+                if(slot==INT32_MAX){ slot=(int32_t)occupied.size(); occupied.emplace_back(); active.push_back(slot); }
+                else if(freeSlots.erase(slot)) active.push_back(slot);
+                slotOf[r]=slot;
+                for(auto& sg:segs) occupied[(size_t)slot].emplace(sg.first,sg.second);
+            }
+            return (uint32_t)occupied.size();
+        };
+        std::vector<int32_t> withHoles(vals.size(),-1), hullOnly(vals.size(),-1);
+        uint32_t nh=color(true,withHoles), nl=color(false,hullOnly);
+        const std::vector<int32_t>& slotOf= nh<=nl? withHoles : hullOnly;
+        S.nSlots=std::min(nh,nl);
+        for(uint32_t r:order) webs[r].slot=slotOf[r];
+
+        for(auto& u:uses) if(!u.drop && webs[find(up,u.val)].needed) S.load[u.expr]=webs[find(up,u.val)].slot;
+        for(uint32_t k=0;k<nParams;++k) S.map.push_back({f.params[k].sym,f.params[k].line,(int32_t)k});
+        for(uint32_t v=0;v<vals.size();++v)
+            if(vals[v].kind==Value::Undef && webs[find(up,v)].needed) S.entryZero.push_back((uint32_t)webs[find(up,v)].slot);
+        std::sort(S.entryZero.begin(),S.entryZero.end()); S.entryZero.erase(std::unique(S.entryZero.begin(),S.entryZero.end()),S.entryZero.end());
+        for(uint32_t v=0;v<vals.size();++v){
+            if(vals[v].kind!=Value::Let) continue;
+            if(!emitted[v]){ ++S.deadStores; continue; }
+            S.store[vals[v].stmt]=webs[find(up,v)].slot;
+            S.map.push_back({vals[v].sym,A.stmt(vals[v].stmt).line,S.store[vals[v].stmt]});
+        }
+        return S;
     }
 };
 
 // ----------------- IR
+// The emitter only produces the long forms (PUSH_IMM64, LOAD_LOCAL, STORE_LOCAL);
+// select_encodings() rewrites them to the compact forms just before linearizing.
+// PUSH_IMM8/PUSH_IMM32 sign-extend; PUSH_CONST indexes the module constant pool.
 enum Op: uint8_t {
     PUSH_IMM64=0x01, ADD=0x02, DUP=0x06,
+    PUSH_IMM8=0x08, PUSH_IMM32=0x09, PUSH_CONST=0x0A,
     STORE_LOCAL=0x10, LOAD_LOCAL=0x11,
+    STORE_LOCAL_0=0x50, STORE_LOCAL_1, STORE_LOCAL_2, STORE_LOCAL_3,
+    STORE_LOCAL_4, STORE_LOCAL_5, STORE_LOCAL_6, STORE_LOCAL_7,
+    LOAD_LOCAL_0=0x58, LOAD_LOCAL_1, LOAD_LOCAL_2, LOAD_LOCAL_3,
+    LOAD_LOCAL_4, LOAD_LOCAL_5, LOAD_LOCAL_6, LOAD_LOCAL_7,
     MAX_=0x30, MIN_=0x31,
     CMP_GT=0x32, CMP_LT=0x33, CMP_EQ=0x34, CMP_NE=0x35, CMP_GE=0x36, CMP_LE=0x37,
     ARR_NEW=0x40, ARR_GET=0x41, ARR_SET=0x42,
     JZ_ABS=0x70, JMP_ABS=0x71,
-    RET=0x21
+    CALL=0x20, RET=0x21,
+    // superinstructions (see kFusions): ADD_LL a b pushes locals[a]+locals[b]
+    // (u8 slots); ADD_IMM adds a sign-extended imm32; STORE_IMM x imm32 sets a
+    // local (u8 slot); JCMP_xx pops b, a and jumps when `a xx b` is false
+    // (CMP_xx; JZ_ABS), in CMP_xx order at +0x40
+    ADD_LL=0x60, ADD_IMM=0x61, STORE_IMM=0x62,
+    JCMP_GT=0x72, JCMP_LT=0x73, JCMP_EQ=0x74, JCMP_NE=0x75, JCMP_GE=0x76, JCMP_LE=0x77
 };
 
+// Name of an opcode's long form (compact encodings fold into their family);
+// used by the pair profiler.
+static const char* op_name(uint8_t op){
+    if(op>=STORE_LOCAL_0 && op<=STORE_LOCAL_7) op=STORE_LOCAL;
+    if(op>=LOAD_LOCAL_0 && op<=LOAD_LOCAL_7) op=LOAD_LOCAL;
+    switch(op){
+        case PUSH_IMM64: case PUSH_IMM8: case PUSH_IMM32: case PUSH_CONST: return "PUSH";
+        case ADD: return "ADD"; case DUP: return "DUP";
+        case STORE_LOCAL: return "STORE_LOCAL"; case LOAD_LOCAL: return "LOAD_LOCAL";
+        case MAX_: return "MAX"; case MIN_: return "MIN";
+        case CMP_GT: return "CMP_GT"; case CMP_LT: return "CMP_LT"; case CMP_EQ: return "CMP_EQ";
+        case CMP_NE: return "CMP_NE"; case CMP_GE: return "CMP_GE"; case CMP_LE: return "CMP_LE";
+        case ARR_NEW: return "ARR_NEW"; case ARR_GET: return "ARR_GET"; case ARR_SET: return "ARR_SET";
+        case JZ_ABS: return "JZ_ABS"; case JMP_ABS: return "JMP_ABS"; case CALL: return "CALL"; case RET: return "RET";
+        case ADD_LL: return "ADD_LL"; case ADD_IMM: return "ADD_IMM"; case STORE_IMM: return "STORE_IMM";
+        case JCMP_GT: return "JCMP_GT"; case JCMP_LT: return "JCMP_LT"; case JCMP_EQ: return "JCMP_EQ";
+        case JCMP_NE: return "JCMP_NE"; case JCMP_GE: return "JCMP_GE"; case JCMP_LE: return "JCMP_LE";
+        default: return "?";
+    }
+}
+
 struct IRInstr{
     Op op;
-    bool hasImm=false; uint64_t imm=0;     // for PUSH_IMM64
-    bool hasIdx=false; uint16_t idx=0;     // for locals
+    bool hasImm=false; uint64_t imm=0;     // for PUSH_IMM64/8/32 and PUSH_CONST
+    bool hasIdx=false; uint16_t idx=0;     // for locals; pool index for PUSH_CONST; function id for CALL
+    uint16_t idx2=0;                       // second local of ADD_LL
     bool hasTarget=false; int target=-1;   // instr index target (for NASM labels)
 };
 
+// Calling convention: CALL f pops f's arguments (the last one is on top) into
+// slots 0..params-1 of a fresh frame on the call-frame stack, zeroes the rest
+// of the frame and enters f; RET pops the result, drops the frame and pushes
+// the result for the caller. RET in the entry scope ends the program. Frames
+// are contiguous and the operand stack is shared, so a call allocates nothing.
+struct CodeFunc{
+    uint32_t entry=0;                      // index of the first instruction in seq
+    uint32_t offset=0;                     // its byte offset in bytes
+    uint32_t params=0, slots=0;            // arguments; frame size (slots >= params)
+    uint32_t maxStack=0;                   // deepest operand stack of one activation (0 on entry)
+};
 struct Code{
     std::vector<IRInstr> seq;              // instruction sequence (for NASM labels)
     std::vector<uint8_t> bytes;            // linearized hex IR (with absolute byte targets)
+    std::vector<uint64_t> consts;          // module constant pool (deduplicated, PUSH_CONST operands)
+    std::vector<CodeFunc> funcs;           // by function id; funcs[0] is the entry, at offset 0
 };
 
-static inline size_t instr_size(const IRInstr& I){
-    switch(I.op){
+// Encoded length of an instruction from its opcode byte; 0 for a byte that is
+// not an opcode.
+static inline size_t op_size(uint8_t op){
+    switch(op){
         case PUSH_IMM64: return 1+8;
+        case PUSH_IMM32: return 1+4;
+        case PUSH_IMM8: return 1+1;
+        case PUSH_CONST: return 1+2;
         case STORE_LOCAL: case LOAD_LOCAL: return 1+2;
         case JZ_ABS: case JMP_ABS: return 1+4;
-        default: return 1;
+        case CALL: return 1+1;
+        case ADD_LL: return 1+2;
+        case ADD_IMM: return 1+4;
+        case STORE_IMM: return 1+1+4;
+        case JCMP_GT: case JCMP_LT: case JCMP_EQ: case JCMP_NE: case JCMP_GE: case JCMP_LE: return 1+4;
+        case ADD: case DUP: case MAX_: case MIN_: case CMP_GT: case CMP_LT: case CMP_EQ: case CMP_NE: case CMP_GE: case CMP_LE:
+        case ARR_NEW: case ARR_GET: case ARR_SET: case RET: return 1;
+        default: return (op>=STORE_LOCAL_0 && op<=LOAD_LOCAL_7)? 1 : 0;
+    }
+}
+static inline size_t instr_size(const IRInstr& I){ return op_size(I.op); }
+
+// Values an instruction pops and pushes (CALL: the callee's params, then 1).
+struct StackUse{ int pops, pushes; };
+static StackUse stack_use(uint8_t op){
+    switch(op){
+        case PUSH_IMM64: case PUSH_IMM32: case PUSH_IMM8: case PUSH_CONST: case LOAD_LOCAL: case ADD_LL: return {0,1};
+        case DUP: return {1,2};
+        case STORE_LOCAL: case JZ_ABS: case RET: return {1,0};
+        case ADD: case MAX_: case MIN_: case ARR_GET: return {2,1};
+        case CMP_GT: case CMP_LT: case CMP_EQ: case CMP_NE: case CMP_GE: case CMP_LE: return {2,1};
+        case ARR_NEW: case ADD_IMM: return {1,1};
+        case ARR_SET: return {3,1};
+        case JCMP_GT: case JCMP_LT: case JCMP_EQ: case JCMP_NE: case JCMP_GE: case JCMP_LE: return {2,0};
+        default:
+            if(op>=LOAD_LOCAL_0 && op<=LOAD_LOCAL_7) return {0,1};
+            if(op>=STORE_LOCAL_0 && op<=STORE_LOCAL_7) return {1,0};
+            return {0,0};
+    }
+}
+// Net operand-stack change of one instruction, RET excepted (it leaves the
+// function with its value, so 0 here).
+static int stack_effect(const IRInstr& I,const std::vector<CodeFunc>& funcs){
+    if(I.op==CALL) return 1-(int)funcs[I.idx].params;
+    if(I.op==RET) return 0;
+    StackUse u=stack_use(I.op); return u.pushes-u.pops;
+}
+static bool falls_through(Op op){ return op!=JMP_ABS && op!=RET; }
+
+// Deepest operand stack function k reaches above the depth it was entered
+// at, over every path from its entry (each instruction's peak is before or
+// after it). The VM sizes its stack from this instead of checking per push.
+static uint32_t max_stack_depth(const Code& c,size_t k){
+    const size_t b0=c.funcs[k].entry, n= k+1<c.funcs.size()? c.funcs[k+1].entry : c.seq.size();
+    std::vector<int> depth(n-b0+1,-1); std::vector<size_t> work;
+    int peak=0;
+    if(n>b0){ depth[0]=0; work.push_back(b0); }
+    while(!work.empty()){
+        size_t i=work.back(); work.pop_back();
+        const IRInstr& I=c.seq[i]; int d=depth[i-b0]+stack_effect(I,c.funcs);
+        if(d<0) throw std::runtime_error("stack depth: underflow in scope "+std::to_string(k));
+        peak=std::max(peak,d);
+        auto reach=[&](size_t t){
+            if(t<b0 || t>n) throw std::runtime_error("stack depth: jump out of scope "+std::to_string(k));
+            int& e=depth[t-b0];
+            if(e<0){ e=d; if(t<n) work.push_back(t); }
+            else if(e!=d) throw std::runtime_error("stack depth: mismatch at join in scope "+std::to_string(k));
+        };
+        if(I.hasTarget) reach((size_t)I.target);
+        if(falls_through(I.op)) reach(i+1);
+    }
+    return (uint32_t)peak;
+}
+
+// ----------------- Peephole optimizer
+// Runs over Code::seq (long forms, instruction-index targets) before
+// finalize_bytes. Window rules come from kPeepRules: a window matches when its
+// opcodes match and no instruction after the first is a branch target, so a
+// rewrite never changes what a jump lands on. Rewrites only kill or replace
+// instructions in place; compaction then drops the dead ones and moves every
+// target to the next surviving instruction.
+//   -O1  one sweep: window rules, jump threading, JMP to the next instruction
+//   -O2  sweeps to a fixed point and also removes code after RET/JMP that no
+//        jump reaches
+static inline bool fold_binop(Op op, int64_t a, int64_t b, int64_t& out){   // VM semantics
+    switch(op){
+        case ADD: out=(int64_t)((uint64_t)a+(uint64_t)b); return true;
+        case MAX_: out=a>b? a:b; return true;
+        case MIN_: out=a<b? a:b; return true;
+        case CMP_GT: out=a>b; return true;  case CMP_LT: out=a<b; return true;
+        case CMP_GE: out=a>=b; return true; case CMP_LE: out=a<=b; return true;
+        case CMP_EQ: out=a==b; return true; case CMP_NE: out=a!=b; return true;
+        default: return false;
+    }
+}
+
+struct PeepRule{
+    const char* name; uint8_t n; Op ops[3];
+    bool (*rewrite)(IRInstr* w, uint8_t* kill);   // may edit w[0..n) and set kill[k]; false = no match
+};
+static const PeepRule kPeepRules[]={
+    // PUSH a; PUSH b; op  ->  PUSH (a op b)
+    #define PS_FOLD_RULE(OP) {"push-push-" #OP,3,{PUSH_IMM64,PUSH_IMM64,OP},[](IRInstr* w,uint8_t* k){ \
+        int64_t v; fold_binop(OP,(int64_t)w[0].imm,(int64_t)w[1].imm,v); w[0].imm=(uint64_t)v; k[1]=k[2]=1; return true; }}
+    PS_FOLD_RULE(ADD), PS_FOLD_RULE(MAX_), PS_FOLD_RULE(MIN_),
+    PS_FOLD_RULE(CMP_GT), PS_FOLD_RULE(CMP_LT), PS_FOLD_RULE(CMP_GE), PS_FOLD_RULE(CMP_LE), PS_FOLD_RULE(CMP_EQ), PS_FOLD_RULE(CMP_NE),
+    #undef PS_FOLD_RULE
+    // x + 0  ->  x
+    {"add-zero",2,{PUSH_IMM64,ADD},[](IRInstr* w,uint8_t* k){ if(w[0].imm) return false; k[0]=k[1]=1; return true; }},
+    // PUSH c; JZ L  ->  JMP L (c==0) or nothing
+    {"const-branch",2,{PUSH_IMM64,JZ_ABS},[](IRInstr* w,uint8_t* k){
+        if(w[0].imm){ k[0]=k[1]=1; return true; }
+        k[0]=1; w[1].op=JMP_ABS; return true; }},
+};
+
+// Drop killed instructions; a target on a dead instruction moves to the next live one.
+static void compact_seq(std::vector<IRInstr>& seq, const std::vector<uint8_t>& kill){
+    const size_t n=seq.size();
+    std::vector<int> remap(n+1);
+    size_t w=0;
+    for(size_t i=0;i<n;++i){ remap[i]=(int)w; if(!kill[i]) seq[w++]=seq[i]; }
+    remap[n]=(int)w;
+    seq.resize(w);
+    for(auto& I:seq) if(I.hasTarget && I.target>=0) I.target=remap[(size_t)I.target];
+}
+
+// Returns the number of instructions removed.
+static size_t peephole(std::vector<IRInstr>& seq, int level){
+    if(level<=0) return 0;
+    const size_t before=seq.size();
+    std::vector<uint8_t> isTarget, kill;
+    for(bool changed=true; changed; ){
+        changed=false;
+        const size_t n=seq.size();
+        isTarget.assign(n+1,0); kill.assign(n,0);
+        for(auto& I:seq) if(I.hasTarget && I.target>=0) isTarget[(size_t)I.target]=1;
+
+        // jump threading: a jump to a JMP goes straight to that JMP's target
+        for(auto& I:seq){
+            if(I.op!=JMP_ABS && I.op!=JZ_ABS) continue;
+            for(size_t hops=0; hops<n && (size_t)I.target<n && seq[(size_t)I.target].op==JMP_ABS && seq[(size_t)I.target].target!=I.target; ++hops){
+                I.target=seq[(size_t)I.target].target; changed=true;
+            }
+        }
+        // window rules
+        for(size_t i=0;i<n;++i){
+            if(kill[i]) continue;
+            for(auto& R:kPeepRules){
+                if(i+R.n>n) continue;
+                bool m=true;
+                for(size_t k=0;k<R.n && m;++k) m = seq[i+k].op==R.ops[k] && !kill[i+k] && (k==0 || !isTarget[i+k]);
+                if(m && R.rewrite(&seq[i],&kill[i])){ changed=true; break; }
+            }
+        }
+        // unreachable code: after RET/JMP up to the next branch target
+        if(level>=2){
+            for(size_t i=0;i<n;++i){
+                if(kill[i] || (seq[i].op!=RET && seq[i].op!=JMP_ABS)) continue;
+                for(size_t k=i+1;k<n && !isTarget[k];++k) if(!kill[k]){ kill[k]=1; changed=true; }
+            }
+        }
+        // JMP to the instruction that would run next anyway
+        for(size_t i=0;i<n;++i){
+            if(kill[i] || seq[i].op!=JMP_ABS || seq[i].target<=(int)i) continue;
+            size_t k=i+1; while(k<(size_t)seq[i].target && kill[k]) ++k;
+            if(k==(size_t)seq[i].target){ kill[i]=1; changed=true; }
+        }
+        compact_seq(seq,kill);
+        if(level<2) break;
     }
+    return before-seq.size();
+}
+
+// ----------------- Superinstructions
+// Fused opcodes for the hottest adjacent pairs, picked from --profile-pairs
+// runs (executed pairs at -O0, share of all pairs executed):
+//   scripts computing on array inputs: LOAD_LOCAL,LOAD_LOCAL 10.9% and
+//     LOAD_LOCAL,ADD 9.6% -> ADD_LL; CMP_xx,JZ_ABS 3.7% -> JCMP_xx;
+//     PUSH,ADD 2.4% -> ADD_IMM
+//   fully folded modules: PUSH,STORE_LOCAL 49% -> STORE_IMM
+// Same matching rule as the peephole pass: no branch target inside a window.
+struct Fusion{ uint8_t n; Op ops[3]; bool (*fuse)(IRInstr* w); };   // fuse rewrites w[0]; the rest is dropped
+static const Fusion kFusions[]={
+    {3,{LOAD_LOCAL,LOAD_LOCAL,ADD},[](IRInstr* w){
+        if(w[0].idx>0xFF || w[1].idx>0xFF) return false;
+        w[0].op=ADD_LL; w[0].idx2=w[1].idx; return true; }},
+    #define PS_JCMP_RULE(OP) {2,{CMP_##OP,JZ_ABS},[](IRInstr* w){ w[1].op=JCMP_##OP; w[0]=w[1]; return true; }}
+    PS_JCMP_RULE(GT), PS_JCMP_RULE(LT), PS_JCMP_RULE(EQ), PS_JCMP_RULE(NE), PS_JCMP_RULE(GE), PS_JCMP_RULE(LE),
+    #undef PS_JCMP_RULE
+    {2,{PUSH_IMM64,ADD},[](IRInstr* w){
+        int64_t v=(int64_t)w[0].imm; if(v<INT32_MIN || v>INT32_MAX) return false;
+        w[0].op=ADD_IMM; return true; }},
+    {2,{PUSH_IMM64,STORE_LOCAL},[](IRInstr* w){
+        int64_t v=(int64_t)w[0].imm; if(v<INT32_MIN || v>INT32_MAX || w[1].idx>0xFF) return false;
+        w[0].op=STORE_IMM; w[0].hasIdx=true; w[0].idx=w[1].idx; return true; }},
+};
+
+static void select_superinstructions(std::vector<IRInstr>& seq){
+    const size_t n=seq.size();
+    std::vector<uint8_t> isTarget(n+1,0), kill(n,0);
+    for(auto& I:seq) if(I.hasTarget && I.target>=0) isTarget[(size_t)I.target]=1;
+    for(size_t i=0;i<n;){
+        size_t step=1;
+        for(auto& F:kFusions){
+            if(i+F.n>n) continue;
+            bool m=true;
+            for(size_t k=0;k<F.n && m;++k) m = seq[i+k].op==F.ops[k] && (k==0 || !isTarget[i+k]);
+            if(m && F.fuse(&seq[i])){ for(size_t k=1;k<F.n;++k) kill[i+k]=1; step=F.n; break; }
+        }
+        i+=step;
+    }
+    compact_seq(seq,kill);
 }
 
 // ----------------- Emitter (with patches)
 struct Emitter{
-    Code code; Typer& T;
-    struct FoldLog{ string what; int line; };
+    Code code; Typer& T; const Module& M; const Ast& A;
+    ConstFolds F;                       // filled by gen_func before code generation
+    std::unordered_map<NodeId,int64_t> exact;   // ever_exact values from CtEval
+    uint64_t ctBudget=kCtEvalSteps;     // compile-time evaluation step budget
+    bool ssa=true;                      // slots from the SSA middle end (off: one slot per name)
+    SsaSlots S;
+    struct PeepStats{ int level=0; size_t before=0, after=0; } peep;
+    // utterly_inline: the Emitter of a scope whose code is ready to copy, or
+    // null (set by ModuleBuild; null while that scope is being generated)
+    std::function<const Emitter*(uint32_t)> inlinee;
+    std::vector<IRInstr> body;          // code.seq as generated, before optimize() (keepBody only)
+    bool keepBody=false;                // some utterly_inline names this scope
+    std::vector<int> inlineFix;         // instrs whose slot is relative to the inline region
+    uint32_t inlineSlots=0;             // inline region size, past the scope's own slots
+    uint32_t nParams=0;
+    Emitter(Typer& t,const Module& m):T(t),M(m),A(m.ast){}
+    struct FoldLog{ string what; uint32_t line; };
     std::vector<FoldLog> folds;
 
     int here() const { return (int)code.seq.size(); }
@@ -346,112 +1801,337 @@ struct Emitter{
     void patch_target(int at, int targetIdx){ code.seq[at].hasTarget=true; code.seq[at].target=targetIdx; }
 
     // ---- Expressions
-    void gen_expr(const Expr* e){
-        switch(e->kind){
-            case Expr::Num: emit_push(e->val); break;
-            case Expr::Var: {
-                auto it=T.locals.find(e->name); if(it==T.locals.end()) throw std::runtime_error("use of undeclared "+e->name);
-                emit_local(LOAD_LOCAL,(uint16_t)it->second.index);
+    void gen_expr(NodeId id){
+        const Expr& e=A.expr(id);
+        if(ssa && S.reuse[id]){ emit_local(LOAD_LOCAL,(uint16_t)S.load[id]); return; }   // value numbering: already in a slot
+        uint64_t CV;
+        if(e.kind!=Expr::Num && F.get(id,CV)){
+            // constant subtree (annotated by ConstFolder): one push, whatever its shape
+            if(e.kind==Expr::Call){
+                if(e.fn==Intrinsic::Max||e.fn==Intrinsic::Min) folds.push_back({"fold:"+gSyms.name(e.sym()),e.line});
+                else if(e.fn==Intrinsic::EverExact) folds.push_back({"fold:ever_exact",e.line});
+                else if(e.fn==Intrinsic::UtterlyInline) folds.push_back({"hint:inline",e.line});
+            }
+            emit_push(CV); return;
+        }
+        switch(e.kind){
+            case Expr::Num: emit_push(e.value()); break;
+            case Expr::Var:{
+                int slot=T.localIndex(e.sym());
+                if(ssa && (slot=S.load[id])<0){ emit_push(0); break; }   // never assigned on any path
+                emit_local(LOAD_LOCAL,(uint16_t)slot);
             } break;
-            case Expr::Add: gen_expr(e->a.get()); gen_expr(e->b.get()); emit_raw(ADD); break;
+            case Expr::Add: gen_expr(e.lhs()); gen_expr(e.rhs()); emit_raw(ADD); break;
             case Expr::Call:{
-                auto nm=e->name;
-                if(nm=="max"||nm=="min"){
-                    uint64_t CV; if(T.is_const_expr(e,CV)){ folds.push_back({"fold:"+nm,e->line}); emit_push(CV); }
-                    else { if(e->args.size()!=2) throw std::runtime_error("max/min need 2 args");
-                           gen_expr(e->args[0].get()); gen_expr(e->args[1].get()); emit_raw(nm=="max"?MAX_:MIN_); }
-                } else if(nm=="ever_exact"){
-                    if(e->args.size()!=1) throw std::runtime_error("ever_exact needs 1 arg");
-                    uint64_t CV; if(T.is_const_expr(e->args[0].get(),CV)){ folds.push_back({"fold:ever_exact",e->line}); emit_push(CV); }
-                    else { gen_expr(e->args[0].get()); }
-                } else if(nm=="utterly_inline"){
-                    if(e->args.size()!=1) throw std::runtime_error("utterly_inline needs 1 arg");
-                    folds.push_back({"hint:inline",e->line}); gen_expr(e->args[0].get());
-                } else if(nm=="gt"||nm=="lt"||nm=="ge"||nm=="le"||nm=="eq"||nm=="ne"){
-                    if(e->args.size()!=2) throw std::runtime_error(nm+" needs 2 args");
-                    uint64_t CV; if(T.is_const_expr(e,CV)){ emit_push(CV); }
-                    else {
-                        gen_expr(e->args[0].get()); gen_expr(e->args[1].get());
-                        emit_raw( nm=="gt"?CMP_GT : nm=="lt"?CMP_LT : nm=="ge"?CMP_GE : nm=="le"?CMP_LE : nm=="eq"?CMP_EQ : CMP_NE );
-                    }
-                } else if(nm=="arr_new"){
-                    if(e->args.size()!=1) throw std::runtime_error("arr_new(n) needs 1 arg");
-                    gen_expr(e->args[0].get()); emit_raw(ARR_NEW);
-                } else if(nm=="arr_get"){
-                    if(e->args.size()!=2) throw std::runtime_error("arr_get(a,i) needs 2 args");
-                    gen_expr(e->args[0].get()); gen_expr(e->args[1].get()); emit_raw(ARR_GET);
-                } else if(nm=="arr_set"){
-                    if(e->args.size()!=3) throw std::runtime_error("arr_set(a,i,v) needs 3 args");
-                    gen_expr(e->args[0].get()); gen_expr(e->args[1].get()); gen_expr(e->args[2].get()); emit_raw(ARR_SET);
-                } else if(nm=="arr_of"){
-                    // arr_of(v0,v1,...)  => arr_new(len); then sets; arr_set returns ptr (so we can chain)
-                    size_t len=e->args.size();
-                    emit_push((uint64_t)len); emit_raw(ARR_NEW); // stack: ptr
-                    for(size_t i=0;i<len;i++){
-                        emit_raw(DUP);               // ptr, ptr
-                        emit_push((uint64_t)i);      // ptr, ptr, i
-                        gen_expr(e->args[i].get());  // ptr, ptr, i, vi
-                        emit_raw(ARR_SET);           // -> ptr
+                const string& nm=gSyms.name(e.sym()); auto args=A.args(e);
+                switch(e.fn){
+                    case Intrinsic::Max: case Intrinsic::Min:{
+                        if(args.size()!=2) throw std::runtime_error("max/min need 2 args");
+                        gen_expr(args[0]); gen_expr(args[1]); emit_raw(e.fn==Intrinsic::Max?MAX_:MIN_);
+                    } break;
+                    case Intrinsic::EverExact:{
+                        if(args.size()!=1) throw std::runtime_error("ever_exact needs 1 arg");
+                        auto it=exact.find(id);
+                        if(it!=exact.end()){ folds.push_back({"fold:ever_exact (evaluated)",e.line}); emit_push((uint64_t)it->second); }
+                        else gen_expr(args[0]);
+                    } break;
+                    case Intrinsic::UtterlyInline:{
+                        if(args.size()!=1) throw std::runtime_error("utterly_inline needs 1 arg");
+                        const Expr& a=A.expr(args[0]);
+                        if(a.kind==Expr::Call && a.fn==Intrinsic::None && gen_inline(a)) break;
+                        folds.push_back({"hint:inline",e.line}); gen_expr(args[0]);
+                    } break;
+                    case Intrinsic::Gt: case Intrinsic::Lt: case Intrinsic::Ge: case Intrinsic::Le: case Intrinsic::Eq: case Intrinsic::Ne:{
+                        if(args.size()!=2) throw std::runtime_error(nm+" needs 2 args");
+                        gen_expr(args[0]); gen_expr(args[1]);
+                        static const Op cmpOp[]={CMP_GT,CMP_LT,CMP_GE,CMP_LE,CMP_EQ,CMP_NE};
+                        emit_raw(cmpOp[int(e.fn)-int(Intrinsic::Gt)]);
+                    } break;
+                    case Intrinsic::ArrNew:{
+                        if(args.size()!=1) throw std::runtime_error("arr_new(n) needs 1 arg");
+                        gen_expr(args[0]); emit_raw(ARR_NEW);
+                    } break;
+                    case Intrinsic::ArrGet:{
+                        if(args.size()!=2) throw std::runtime_error("arr_get(a,i) needs 2 args");
+                        gen_expr(args[0]); gen_expr(args[1]); emit_raw(ARR_GET);
+                    } break;
+                    case Intrinsic::ArrSet:{
+                        if(args.size()!=3) throw std::runtime_error("arr_set(a,i,v) needs 3 args");
+                        gen_expr(args[0]); gen_expr(args[1]); gen_expr(args[2]); emit_raw(ARR_SET);
+                    } break;
+                    case Intrinsic::ArrOf:{
+                        // arr_of(v0,v1,...)  => arr_new(len); then sets; arr_set returns ptr (so we can chain)
+                        size_t len=args.size();
+                        emit_push((uint64_t)len); emit_raw(ARR_NEW); // stack: ptr
+                        for(size_t i=0;i<len;i++){
+                            emit_push((uint64_t)i);      // ptr, i
+                            gen_expr(args[(uint32_t)i]);  // ptr, i, vi
+                            emit_raw(ARR_SET);           // -> ptr (arr_set hands the handle back; no DUP)
+                        }
+                    } break;
+                    default:{
+                        int k=M.find(e.sym()); if(k<0) throw std::runtime_error("unknown call '"+nm+"'");
+                        for(NodeId a:call_args(e,(uint32_t)k)) gen_expr(a);
+                        IRInstr I{CALL}; I.hasIdx=true; I.idx=(uint16_t)k; code.seq.push_back(I);
                     }
-                } else {
-                    throw std::runtime_error("unknown call '"+nm+"'");
                 }
             } break;
         }
     }
+    Ast::List call_args(const Expr& e,uint32_t k){
+        auto args=A.args(e); const Func& g=M.funcs[k];
+        if(args.size()!=g.params.size()) throw std::runtime_error(g.name+" takes "+std::to_string(g.params.size())+" args (line "+std::to_string(e.line)+")");
+        return args;
+    }
+    // utterly_inline(f(...)): a copy of f's code instead of the CALL. The
+    // arguments go to f's slots, moved past this scope's own slots once they
+    // are known; RET becomes a jump past the copy. False when f is not ready
+    // (it is being generated: recursion), so the call stays.
+    bool gen_inline(const Expr& call){
+        int k=M.find(call.sym());
+        const Emitter* g= k>=0 && inlinee? inlinee((uint32_t)k) : nullptr;
+        if(!g) return false;
+        auto args=call_args(call,(uint32_t)k);
+        for(NodeId a:args) gen_expr(a);
+        for(uint32_t i=args.size();i-->0;) inlineFix.push_back(emit_local(STORE_LOCAL,(uint16_t)i));
+        for(uint32_t z:g->entry_zero()){ emit_push(0); inlineFix.push_back(emit_local(STORE_LOCAL,(uint16_t)z)); }
+        const int start=here(), end=start+(int)g->body.size();
+        for(IRInstr I:g->body){
+            if(I.op==RET){ I=IRInstr{JMP_ABS}; I.hasTarget=true; I.target=end; }
+            else if(I.hasTarget) I.target+=start;
+            code.seq.push_back(I);
+            if(I.op==LOAD_LOCAL || I.op==STORE_LOCAL) inlineFix.push_back(here()-1);
+        }
+        inlineSlots=std::max(inlineSlots,(uint32_t)g->frame_slots());
+        folds.push_back({"inline:"+M.funcs[(size_t)k].name,call.line});
+        return true;
+    }
 
     // ---- Statements
-    void gen_stmt(const Stmt& s){
+    // Each returns true when control cannot fall through (every path hit RET).
+    // Statements that can never run are not emitted, but their locals are still
+    // declared so slots and metadata match the source.
+    bool gen_block(Ast::List body){
+        for(uint32_t i=0;i<body.size();++i){
+            if(!gen_stmt(body[i])) continue;
+            if(i+1<body.size()){
+                folds.push_back({"dce:after-ret",A.stmt(body[i+1]).line});
+                for(uint32_t k=i+1;k<body.size();++k) declare_stmt(body[k]);
+            }
+            return true;
+        }
+        return false;
+    }
+    bool gen_stmt(NodeId id){
+        const Stmt& s=A.stmt(id);
         switch(s.kind){
             case Stmt::Let:{
-                Type::K tk = (s.etype==Stmt::T_Int)?Type::Int : (s.etype==Stmt::T_Arr)?Type::Arr : T.infer_type(s.expr.get());
-                bool explicitType=(s.etype!=Stmt::T_Implicit);
-                T.declare_local(s.name,s.line,explicitType,tk);
-                gen_expr(s.expr.get());
-                emit_local(STORE_LOCAL,(uint16_t)T.locals.at(s.name).index);
-            } break;
-            case Stmt::Ret:{ gen_expr(s.expr.get()); emit_raw(RET); } break;
+                declare(s);
+                if(ssa && S.store[id]<0){
+                    // dead store: generated and dropped, so it is checked
+                    // (names, argument counts) the same as at -O0
+                    const size_t mark=code.seq.size(), nf=folds.size(), nfix=inlineFix.size();
+                    gen_expr(s.expr());
+                    code.seq.resize(mark); folds.resize(nf); inlineFix.resize(nfix);
+                    return false;
+                }
+                gen_expr(s.expr());
+                emit_local(STORE_LOCAL,(uint16_t)(ssa? S.store[id] : T.localIndex(s.sym())));
+            } return false;
+            case Stmt::Ret:{ gen_expr(s.expr()); emit_raw(RET); } return true;
             case Stmt::If:{
-                gen_expr(s.cond.get());
+                uint64_t c;
+                if(F.get(s.cond(),c)){
+                    // constant condition: only the taken arm, no jumps
+                    folds.push_back({"dce:if",s.line});
+                    if(c){ bool t=gen_block(A.then_body(s)); declare_all(A.else_body(s)); return t; }
+                    declare_all(A.then_body(s)); return gen_block(A.else_body(s));
+                }
+                gen_expr(s.cond());
                 int jz=emit_jmp(JZ_ABS,-1);
-                for(auto& st:s.thenBody) gen_stmt(st);
-                int jmpEnd=emit_jmp(JMP_ABS,-1);
-                int elseAt=here();
-                patch_target(jz, elseAt);
-                for(auto& st:s.elseBody) gen_stmt(st);
-                int endAt=here();
-                patch_target(jmpEnd, endAt);
-            } break;
+                bool thenRet=gen_block(A.then_body(s));
+                int jmpEnd=thenRet? -1 : emit_jmp(JMP_ABS,-1);   // nothing to jump over after RET
+                patch_target(jz, here());
+                bool elseRet=gen_block(A.else_body(s));
+                if(jmpEnd>=0) patch_target(jmpEnd, here());
+                return thenRet && elseRet;
+            }
+        }
+        return false;
+    }
+
+    void declare(const Stmt& s){
+        Type::K tk = (s.etype==Stmt::T_Int)?Type::Int : (s.etype==Stmt::T_Arr)?Type::Arr : Typer::infer_type(A.expr(s.expr()));
+        bool explicitType=(s.etype!=Stmt::T_Implicit);
+        T.declare_local(s.sym(),s.line,explicitType,tk);
+    }
+    // declare the locals of statements that are not emitted, in source order
+    void declare_stmt(NodeId id){
+        const Stmt& s=A.stmt(id);
+        if(s.kind==Stmt::Let) declare(s);
+        else if(s.kind==Stmt::If){ declare_all(A.then_body(s)); declare_all(A.else_body(s)); }
+    }
+    void declare_all(Ast::List body){ for(NodeId id:body) declare_stmt(id); }
+
+    void gen_func(const Func& f){
+        nParams=(uint32_t)f.params.size();
+        for(auto& p:f.params) T.declare_local(p.sym,(int)p.line,p.etype!=Stmt::T_Implicit,p.etype==Stmt::T_Arr? Type::Arr : Type::Int);
+        ConstFolder(A,F).run(f);
+        // the entry scope has no inputs, so it can run at build time
+        bool hasExact= &f==&M.funcs[0] && std::any_of(A.exprs.begin(),A.exprs.end(),[](const Expr& e){ return e.kind==Expr::Call && e.fn==Intrinsic::EverExact; });
+        if(hasExact){
+            CtEval ct(M,ctBudget); ct.run(f);
+            if(ct.exhausted) T.warns.push_back({"W101","ever_exact: compile-time step budget ("+std::to_string(ctBudget)+") exhausted",f.line});
+            exact=std::move(ct.exact);
+            // `return ever_exact(...)` reached: nothing else is observable, so the
+            // whole function is its value
+            if(ct.returned){
+                const Stmt& r=A.stmt(ct.retStmt); const Expr& e=A.expr(r.expr());
+                if(e.kind==Expr::Call && e.fn==Intrinsic::EverExact){
+                    declare_all(A.list(f.body));
+                    folds.push_back({"fold:program",r.line});
+                    emit_push((uint64_t)ct.result); emit_raw(RET);
+                    if(keepBody) body=code.seq;
+                    return;
+                }
+            }
         }
+        if(ssa) S=SsaBuilder(A,F,exact).run(f);
+        if(!gen_block(A.list(f.body))){ emit_push(0); emit_raw(RET); }   // falling off the end returns 0
+        const uint32_t base=own_slots();
+        for(int i:inlineFix){
+            uint32_t x=base+code.seq[(size_t)i].idx;
+            if(x>UINT16_MAX) throw std::runtime_error("scope "+f.name+": frame too large to inline into");
+            code.seq[(size_t)i].idx=(uint16_t)x;
+        }
+        if(keepBody) body=code.seq;
+    }
+    uint32_t own_slots() const { return ssa? S.nSlots : (uint32_t)T.locals.size(); }
+    // VM locals / native frame slots
+    int frame_slots() const { return (int)(own_slots()+inlineSlots); }
+    // slots that must read 0 on entry (past the arguments)
+    std::vector<uint32_t> entry_zero() const {
+        if(ssa) return S.entryZero;
+        std::vector<uint32_t> z;
+        for(uint32_t i=nParams;i<T.locals.size();++i) z.push_back(i);
+        return z;
     }
 
-    void gen_func(const Func& f){ for(auto& s:f.body) gen_stmt(s); }
+    // ---- peephole pass (level 0 = off); counts go to the metadata
+    void optimize(int level){
+        peep.level=level; peep.before=code.seq.size();
+        peephole(code.seq,level);
+        if(level>=1) select_superinstructions(code.seq);
+        peep.after=code.seq.size();
+    }
+};
 
-    // ---- finalize bytes with absolute targets
-    void finalize_bytes(){
-        // map instr index -> byte offset
-        std::vector<uint32_t> off(code.seq.size()+1,0);
-        for(size_t i=0;i<code.seq.size();++i) off[i+1] = off[i] + (uint32_t)instr_size(code.seq[i]);
-        code.bytes.clear(); code.bytes.reserve(off.back());
-        auto out_u8=[&](uint8_t v){ code.bytes.push_back(v); };
-        auto out_u16=[&](uint16_t v){ code.bytes.push_back((uint8_t)(v&0xFF)); code.bytes.push_back((uint8_t)((v>>8)&0xFF)); };
-        auto out_u32=[&](uint32_t v){ code.bytes.push_back((uint8_t)(v&0xFF)); code.bytes.push_back((uint8_t)((v>>8)&0xFF)); code.bytes.push_back((uint8_t)((v>>16)&0xFF)); code.bytes.push_back((uint8_t)((v>>24)&0xFF)); };
-        auto out_u64=[&](uint64_t v){ for(int i=0;i<8;i++) code.bytes.push_back((uint8_t)((v>>(i*8))&0xFF)); };
+// ----------------- Module build (scopes -> one Code)
+// Each scope is compiled by its own Emitter (own locals, folds and slots) and
+// optimized on its own. A scope is generated before any scope that inlines it;
+// an inline request that would recurse stays a CALL. link() lays the scopes
+// out back to back, entry first, and rebases their jump targets.
 
-        for(size_t i=0;i<code.seq.size();++i){
-            const auto& I=code.seq[i];
-            out_u8((uint8_t)I.op);
-            switch(I.op){
-                case PUSH_IMM64: out_u64(I.imm); break;
-                case STORE_LOCAL: case LOAD_LOCAL: out_u16(I.idx); break;
-                case JZ_ABS: case JMP_ABS:{
-                    uint32_t tgt = I.hasTarget? off[(size_t)I.target] : 0;
-                    out_u32(tgt);
-                } break;
-                default: break;
+// Pick the smallest encoding for each immediate and local access. Values that
+// need all 64 bits go to the constant pool, one entry per distinct value;
+// instruction indices are unchanged so targets stay valid.
+static void select_encodings(Code& code){
+    std::unordered_map<uint64_t,uint16_t> poolIdx;
+    for(size_t i=0;i<code.consts.size();++i) poolIdx.emplace(code.consts[i],(uint16_t)i);
+    for(auto& I: code.seq){
+        if(I.op==PUSH_IMM64){
+            int64_t v=(int64_t)I.imm;
+            if(v>=INT8_MIN && v<=INT8_MAX) I.op=PUSH_IMM8;
+            else if(v>=INT32_MIN && v<=INT32_MAX) I.op=PUSH_IMM32;
+            else{
+                auto it=poolIdx.find(I.imm);
+                if(it==poolIdx.end()){
+                    if(code.consts.size()>UINT16_MAX) continue; // pool full: keep the inline form
+                    it=poolIdx.emplace(I.imm,(uint16_t)code.consts.size()).first;
+                    code.consts.push_back(I.imm);
+                }
+                I.op=PUSH_CONST; I.hasIdx=true; I.idx=it->second;
             }
+        } else if(I.op==LOAD_LOCAL && I.idx<8) I.op=(Op)(LOAD_LOCAL_0+I.idx);
+        else if(I.op==STORE_LOCAL && I.idx<8) I.op=(Op)(STORE_LOCAL_0+I.idx);
+    }
+}
+
+// Linearize with absolute byte targets; fills in each function's offset.
+static void finalize_bytes(Code& code){
+    select_encodings(code);
+    // map instr index -> byte offset
+    std::vector<uint32_t> off(code.seq.size()+1,0);
+    for(size_t i=0;i<code.seq.size();++i) off[i+1] = off[i] + (uint32_t)instr_size(code.seq[i]);
+    for(auto& f:code.funcs) f.offset=off[f.entry];
+    code.bytes.clear(); code.bytes.reserve(off.back());
+    auto out_u8=[&](uint8_t v){ code.bytes.push_back(v); };
+    auto out_u16=[&](uint16_t v){ code.bytes.push_back((uint8_t)(v&0xFF)); code.bytes.push_back((uint8_t)((v>>8)&0xFF)); };
+    auto out_u32=[&](uint32_t v){ code.bytes.push_back((uint8_t)(v&0xFF)); code.bytes.push_back((uint8_t)((v>>8)&0xFF)); code.bytes.push_back((uint8_t)((v>>16)&0xFF)); code.bytes.push_back((uint8_t)((v>>24)&0xFF)); };
+    auto out_u64=[&](uint64_t v){ for(int i=0;i<8;i++) code.bytes.push_back((uint8_t)((v>>(i*8))&0xFF)); };
+
+    for(size_t i=0;i<code.seq.size();++i){
+        const auto& I=code.seq[i];
+        out_u8((uint8_t)I.op);
+        switch(I.op){
+            case PUSH_IMM64: out_u64(I.imm); break;
+            case PUSH_IMM32: out_u32((uint32_t)I.imm); break;
+            case PUSH_IMM8: out_u8((uint8_t)I.imm); break;
+            case PUSH_CONST: out_u16(I.idx); break;
+            case STORE_LOCAL: case LOAD_LOCAL: out_u16(I.idx); break;
+            case JZ_ABS: case JMP_ABS:
+            case JCMP_GT: case JCMP_LT: case JCMP_EQ: case JCMP_NE: case JCMP_GE: case JCMP_LE:{
+                uint32_t tgt = I.hasTarget? off[(size_t)I.target] : 0;
+                out_u32(tgt);
+            } break;
+            case CALL: out_u8((uint8_t)I.idx); break;
+            case ADD_LL: out_u8((uint8_t)I.idx); out_u8((uint8_t)I.idx2); break;
+            case ADD_IMM: out_u32((uint32_t)I.imm); break;
+            case STORE_IMM: out_u8((uint8_t)I.idx); out_u32((uint32_t)I.imm); break;
+            default: break;
         }
     }
+}
+
+struct ModuleBuild{
+    const Module& M;
+    std::deque<Typer> T; std::deque<Emitter> E;   // by function id
+    std::vector<uint8_t> state;                   // 0: not generated, 1: generating, 2: done
+    Code code;                                    // linked and linearized
+
+    ModuleBuild(const Module& m,uint64_t ctSteps,int optLevel):M(m),state(m.funcs.size(),0){
+        for(size_t k=0;k<m.funcs.size();++k){
+            T.emplace_back(); E.emplace_back(T.back(),m);
+            Emitter& e=E.back(); e.ctBudget=ctSteps; e.ssa=optLevel>=1;
+            e.inlinee=[this](uint32_t g){ return gen(g)? &E[g] : nullptr; };
+        }
+        for(const Expr& x:m.ast.exprs) if(x.kind==Expr::Call && x.fn==Intrinsic::UtterlyInline){
+            auto args=m.ast.args(x);
+            if(args.size()!=1) continue;
+            const Expr& a=m.ast.expr(args[0]); int k;
+            if(a.kind==Expr::Call && a.fn==Intrinsic::None && (k=m.find(a.sym()))>=0) E[(size_t)k].keepBody=true;
+        }
+        for(uint32_t k=0;k<m.funcs.size();++k) gen(k);
+        for(auto& e:E) e.optimize(optLevel);
+        link(); finalize_bytes(code);
+    }
+    ModuleBuild(const ModuleBuild&)=delete;
+    // true once scope k's code is ready, false while it is being generated
+    bool gen(uint32_t k){
+        if(state[k]==0){ state[k]=1; E[k].gen_func(M.funcs[k]); state[k]=2; }
+        return state[k]==2;
+    }
+    void link(){
+        size_t n=0; for(auto& e:E) n+=e.code.seq.size();
+        code.seq.reserve(n);
+        for(size_t k=0;k<E.size();++k){
+            CodeFunc f; f.entry=(uint32_t)code.seq.size(); f.params=(uint32_t)M.funcs[k].params.size(); f.slots=(uint32_t)E[k].frame_slots();
+            code.funcs.push_back(f);
+            for(IRInstr& I:E[k].code.seq){ if(I.hasTarget && I.target>=0) I.target+=(int)f.entry; code.seq.push_back(I); }
+            std::vector<IRInstr>().swap(E[k].code.seq);   // moved into the module
+        }
+        for(size_t k=0;k<code.funcs.size();++k) code.funcs[k].maxStack=max_stack_depth(code,k);
+    }
 };
 
 // ----------------- Range/Capsules (simple guard)
@@ -470,41 +2150,589 @@ template<class T> struct CapsuleHandle{
 };
 template<class T> static CapsuleHandle<T> capsule_alloc(CapsuleArena&A,size_t n){ auto p=reinterpret_cast<T*>(A.alloc(n*sizeof(T))); for(size_t i=0;i<n;i++) new(&p[i])T(); return CapsuleHandle<T>{p,n,A.range}; }
 
+// ----------------- Bytecode verifier
+// Proves a program safe for VM::run once, before any of it runs, so the
+// interpreter loop needs no per-instruction checks:
+//   - each function's bytes, [offset, next function's offset), decode to
+//     whole instructions with known opcodes
+//   - local slots are below the function's frame size, constants are in the
+//     pool, CALL names an existing function, jump targets are instruction
+//     starts inside the same function
+//   - along every path from a function's entry: the operand-stack height is
+//     the same on every path into an instruction, no instruction pops more
+//     than its activation pushed, the height stays within the declared
+//     maxStack (itself no larger than the function), RET leaves exactly
+//     its result, and control never falls off the end (RET or a jump last)
+// Everything the VM runs goes through here: compiled modules and .parx files.
+static void verify_program(const Code& c){
+    const std::vector<uint8_t>& b=c.bytes; const size_t n=b.size();
+    auto fail=[&](size_t at,const string& why){ throw std::runtime_error("verify: "+why+" at byte "+std::to_string(at)); };
+    auto u=[&](size_t at,int w){ uint64_t v=0; for(int i=0;i<w;i++) v|=(uint64_t)b[at+i]<<(i*8); return v; };
+    auto is_jump=[](uint8_t op){ return op==JZ_ABS || op==JMP_ABS || (op>=JCMP_GT && op<=JCMP_LE); };
+    if(c.funcs.empty() || c.funcs[0].offset!=0) fail(0,"no entry function at offset 0");
+    if(c.funcs[0].params) fail(0,"entry function takes arguments");
+    if(c.funcs.size()>256) fail(0,"more than 256 functions");
+    for(size_t k=0;k<c.funcs.size();++k){
+        const CodeFunc& f=c.funcs[k];
+        if(f.offset>=n || (k && f.offset<=c.funcs[k-1].offset)) fail(f.offset,"function "+std::to_string(k)+" has a bad offset");
+        if(f.params>f.slots || f.slots>65536) fail(f.offset,"function "+std::to_string(k)+" has a bad frame");
+        // no instruction raises the height by more than one, so a region of
+        // m bytes never needs more than m slots; larger is a forged header
+        const size_t hi= k+1<c.funcs.size()? c.funcs[k+1].offset : n;
+        if(hi>f.offset && f.maxStack>hi-f.offset) fail(f.offset,"function "+std::to_string(k)+" declares an operand stack of "+std::to_string(f.maxStack));
+    }
+    std::vector<uint8_t> start(n,0);    // instruction starts
+    std::vector<int> depth(n,-1);       // stack height on entry, per reached instruction
+    for(size_t k=0;k<c.funcs.size();++k){
+        const CodeFunc& f=c.funcs[k];
+        const size_t lo=f.offset, hi= k+1<c.funcs.size()? c.funcs[k+1].offset : n;
+        for(size_t ip=lo;ip<hi;){
+            const uint8_t op=b[ip]; const size_t len=op_size(op);
+            if(!len) fail(ip,"bad opcode "+std::to_string(op));
+            if(ip+len>hi) fail(ip,"truncated instruction");
+            start[ip]=1; ip+=len;
+        }
+        // operands, every instruction
+        for(size_t ip=lo;ip<hi;ip+=op_size(b[ip])){
+            const uint8_t op=b[ip];
+            size_t slot=0; bool hasSlot=true;
+            switch(op){
+                case LOAD_LOCAL: case STORE_LOCAL: slot=u(ip+1,2); break;
+                case STORE_IMM: slot=b[ip+1]; break;
+                case ADD_LL: slot=std::max(b[ip+1],b[ip+2]); break;
+                default:
+                    if(op>=STORE_LOCAL_0 && op<=STORE_LOCAL_7) slot=op-STORE_LOCAL_0;
+                    else if(op>=LOAD_LOCAL_0 && op<=LOAD_LOCAL_7) slot=op-LOAD_LOCAL_0;
+                    else hasSlot=false;
+            }
+            if(hasSlot && slot>=f.slots) fail(ip,"local "+std::to_string(slot)+" outside a frame of "+std::to_string(f.slots));
+            if(op==PUSH_CONST && u(ip+1,2)>=c.consts.size()) fail(ip,"constant "+std::to_string(u(ip+1,2))+" outside the pool");
+            if(op==CALL && b[ip+1]>=c.funcs.size()) fail(ip,"CALL to function "+std::to_string(b[ip+1])+" of "+std::to_string(c.funcs.size()));
+            if(is_jump(op)){
+                size_t t=u(ip+1,4);
+                if(t<lo || t>=hi) fail(ip,"jump leaves function "+std::to_string(k));
+                if(!start[t]) fail(ip,"jump into the middle of an instruction");
+            }
+        }
+        // stack heights, every path from the entry
+        std::vector<size_t> work{lo}; depth[lo]=0;
+        auto reach=[&](size_t from,size_t t,int d){
+            if(t>=hi) fail(from,"control falls off the end of function "+std::to_string(k));
+            if(depth[t]<0){ depth[t]=d; work.push_back(t); }
+            else if(depth[t]!=d) fail(t,"stack height "+std::to_string(depth[t])+" vs "+std::to_string(d)+" at a join");
+        };
+        while(!work.empty()){
+            const size_t ip=work.back(); work.pop_back();
+            const uint8_t op=b[ip]; const int d=depth[ip];
+            StackUse su= op==CALL? StackUse{(int)c.funcs[b[ip+1]].params,1} : stack_use(op);
+            if(su.pops>d) fail(ip,string(op_name(op))+" pops "+std::to_string(su.pops)+" with "+std::to_string(d)+" on the stack");
+            const int after=d-su.pops+su.pushes;
+            if((uint32_t)std::max(d,after)>f.maxStack) fail(ip,"stack height "+std::to_string(std::max(d,after))+" over the declared maximum "+std::to_string(f.maxStack));
+            if(op==RET){
+                // anything left under the result would stay on the shared
+                // stack, above the room the caller's CALL made sure of
+                if(d!=1) fail(ip,"RET with "+std::to_string(d)+" values on the stack");
+                continue;
+            }
+            if(is_jump(op)) reach(ip,(size_t)u(ip+1,4),after);
+            if(op!=JMP_ABS) reach(ip,ip+op_size(op),after);
+        }
+    }
+}
+
 // ----------------- VM (with arrays)
-struct VM{
-    const std::vector<uint8_t>& b; std::vector<int64_t> stack; std::vector<int64_t> locals;
-    // array heap: id -> vector<int64_t>
+// Handle-based array heap shared by the interpreters: handles are 1-based,
+// reads out of range give 0 and writes out of range are dropped.
+struct ArrayHeap{
     std::vector<std::vector<int64_t>> arrays;
+    int64_t alloc(int64_t len){ if(len<0) len=0; arrays.emplace_back((size_t)len,0); return (int64_t)arrays.size(); }
+    int64_t get(int64_t id,int64_t idx) const {
+        if(id>0 && (size_t)id<=arrays.size()){ auto& a=arrays[(size_t)id-1]; if(idx>=0 && (size_t)idx<a.size()) return a[(size_t)idx]; }
+        return 0;
+    }
+    void set(int64_t id,int64_t idx,int64_t v){
+        if(id>0 && (size_t)id<=arrays.size()){ auto& a=arrays[(size_t)id-1]; if(idx>=0 && (size_t)idx<a.size()) a[(size_t)idx]=v; }
+    }
+};
 
-    explicit VM(const std::vector<uint8_t>& bytes,int localCount):b(bytes),locals(localCount,0){}
-    inline uint32_t get_u32(size_t& ip){ uint32_t v=b[ip]|(b[ip+1]<<8)|(b[ip+2]<<16)|(b[ip+3]<<24); ip+=4; return v; }
-    inline uint16_t get_u16(size_t& ip){ uint16_t v=b[ip]|(b[ip+1]<<8); ip+=2; return v; }
-    inline uint64_t get_u64(size_t& ip){ uint64_t v=0; for(int i=0;i<8;i++) v|=(uint64_t)b[ip+i]<<(i*8); ip+=8; return v; }
+// Call depth limit of the interpreters (frames on the call-frame stack).
+static const size_t kMaxCallDepth=100000;
 
-    int64_t run_all(){
-        size_t ip=0;
+// One hex-IR instruction, decoded once when the VM is built: operands in
+// native form, PUSH_CONST already resolved from the pool, jump and call
+// targets as record addresses. The op byte is kept, so the handlers and the
+// pair profiler still see the encoding that was chosen.
+struct alignas(16) DInstr{
+    uint8_t op=0; uint8_t x=0;          // x: ADD_LL second slot
+    uint16_t a=0;                       // local slot; function id for CALL
+    uint32_t pad=0;
+    union{ int64_t imm; const DInstr* tgt; };
+    DInstr():imm(0){}
+};
+static_assert(sizeof(DInstr)==16,"DInstr is one 16-byte record");
+
+// Runs only verified programs (the constructor verifies), so handlers trust
+// their operands: no end-of-code, stack-underflow or frame-index checks.
+struct VM{
+    const std::vector<CodeFunc>& fn;
+    std::vector<DInstr> code;           // decoded program
+    // Operand stack: a raw array sized from CodeFunc::maxStack, so pushes
+    // and pops are bare pointer moves. Only CALL checks room (for the
+    // callee's maxStack) and grows it; nothing in between can overflow.
+    std::unique_ptr<int64_t[]> stack; size_t stackCap=0;
+    std::vector<int64_t> frames;        // call-frame stack: the frames of the active calls, back to back
+    struct Call{ const DInstr* ret; uint32_t fp, top; };   // caller's resume point and frame
+    std::vector<Call> calls;
+    ArrayHeap heap;
+
+    explicit VM(const Code& c):fn(c.funcs){
+        verify_program(c);
+        decode(c); calls.reserve(64);
+        frames.assign(std::max<size_t>(fn[0].slots,256),0);
+        stackCap=std::max<size_t>(fn[0].maxStack,256); stack.reset(new int64_t[stackCap]);
+    }
+
+    // bytes -> records, for a verified program
+    void decode(const Code& c){
+        const std::vector<uint8_t>& b=c.bytes; const size_t n=b.size();
+        auto u=[&](size_t at,int w){ uint64_t v=0; for(int i=0;i<w;i++) v|=(uint64_t)b[at+i]<<(i*8); return v; };
+        std::vector<uint32_t> rec(n,UINT32_MAX);     // byte offset -> record index
+        std::vector<uint32_t> target;                // per record: target byte offset
+        for(size_t ip=0;ip<n;){
+            uint8_t op=b[ip]; size_t len=op_size(op);
+            rec[ip]=(uint32_t)code.size();
+            DInstr d; d.op=op; uint32_t t=UINT32_MAX;
+            switch(op){
+                case PUSH_IMM64: d.imm=(int64_t)u(ip+1,8); break;
+                case PUSH_IMM32: case ADD_IMM: d.imm=(int32_t)u(ip+1,4); break;
+                case PUSH_IMM8: d.imm=(int8_t)b[ip+1]; break;
+                case PUSH_CONST: d.imm=(int64_t)c.consts[u(ip+1,2)]; break;
+                case LOAD_LOCAL: case STORE_LOCAL: d.a=(uint16_t)u(ip+1,2); break;
+                case ADD_LL: d.a=b[ip+1]; d.x=b[ip+2]; break;
+                case STORE_IMM: d.a=b[ip+1]; d.imm=(int32_t)u(ip+2,4); break;
+                case CALL: d.a=b[ip+1]; t=fn[d.a].offset; break;
+                case JZ_ABS: case JMP_ABS: case JCMP_GT: case JCMP_LT: case JCMP_EQ: case JCMP_NE: case JCMP_GE: case JCMP_LE:
+                    t=(uint32_t)u(ip+1,4); break;
+                default: break;
+            }
+            code.push_back(d); target.push_back(t); ip+=len;
+        }
+        for(size_t i=0;i<target.size();++i) if(target[i]!=UINT32_MAX) code[i].tgt=&code[rec[target[i]]];
+    }
+    // room for `need` more values above sp; returns the rebased sp
+    int64_t* grow_stack(int64_t* sp,size_t need){
+        size_t used=(size_t)(sp-stack.get()), cap=std::max(stackCap*2,used+need);
+        std::unique_ptr<int64_t[]> s(new int64_t[cap]); std::copy(stack.get(),sp,s.get());
+        stack=std::move(s); stackCap=cap; return stack.get()+used;
+    }
+
+    std::vector<uint64_t> pairs;        // --profile-pairs: prev*256+op -> count
+
+    int64_t run_all(){ return run<false,PARASHADE_THREADED>(); }
+    int64_t run_profiled(){ pairs.assign(256*256,0); return run<true,PARASHADE_THREADED>(); }
+
+    // Every handler is a case ending in VM_NEXT. Threaded: VM_NEXT fetches the
+    // next opcode and jumps through `disp` itself, so each handler has its own
+    // indirect branch (predicted per opcode, not for all of them at once);
+    // the switch only takes the first dispatch. Switch: VM_NEXT is `break`,
+    // the portable loop and what --bench-vm compares against.
+    //
+    // Top-of-stack caching: up to two operand-stack values live in r0 (top)
+    // and r1 (second) instead of memory. The cache state is how many are held,
+    // S0, S1 or S2. It is part of the dispatch key, (state<<8)|op, and every
+    // opcode has one handler per entry state, each of which knows its exit
+    // state. So `a b ADD` in S0 runs without touching the memory stack, a
+    // binary op in S2 is one register op, and the state needs no checks. The
+    // logical stack is stack[0, sp) followed by the cached values.
+    // Array ops spill the cache (exit S0), CALL moves it into the callee's
+    // frame (exit S0), and RET leaves its result in r0 (exit S1).
+#define VM_OPS(X) X(PUSH_IMM64) X(PUSH_IMM32) X(PUSH_IMM8) X(PUSH_CONST) X(LOAD_LOCAL) X(STORE_LOCAL) \
+    X(LOAD_LOCAL_0) X(LOAD_LOCAL_1) X(LOAD_LOCAL_2) X(LOAD_LOCAL_3) X(LOAD_LOCAL_4) X(LOAD_LOCAL_5) X(LOAD_LOCAL_6) X(LOAD_LOCAL_7) \
+    X(STORE_LOCAL_0) X(STORE_LOCAL_1) X(STORE_LOCAL_2) X(STORE_LOCAL_3) X(STORE_LOCAL_4) X(STORE_LOCAL_5) X(STORE_LOCAL_6) X(STORE_LOCAL_7) \
+    X(DUP) X(ADD) X(MAX_) X(MIN_) X(CMP_GT) X(CMP_LT) X(CMP_EQ) X(CMP_NE) X(CMP_GE) X(CMP_LE) \
+    X(ARR_NEW) X(ARR_GET) X(ARR_SET) X(JZ_ABS) X(JMP_ABS) X(ADD_LL) X(ADD_IMM) X(STORE_IMM) \
+    X(JCMP_GT) X(JCMP_LT) X(JCMP_EQ) X(JCMP_NE) X(JCMP_GE) X(JCMP_LE) X(CALL) X(RET)
+#define VM_FETCH \
+    I=ip++; op=I->op; \
+    if(Profile){ pairs[prev*256u+op]++; prev=op; }
+#if PARASHADE_THREADED
+#define VM_H(s,o) case (s<<8)|o: L##s##_##o:
+#define VM_NEXT(s) { if(Threaded){ VM_FETCH PS_DISPATCH_SITE; goto *disp[(s<<8)+op]; } st=s<<8; break; }
+#else
+#define VM_H(s,o) case (s<<8)|o:
+#define VM_NEXT(s) { st=s<<8; break; }
+#endif
+    // one handler per entry state, by stack effect
+#define VM_PUSH(o,...) \
+    VM_H(0,o) r0=(__VA_ARGS__); VM_NEXT(1) \
+    VM_H(1,o) r1=r0; r0=(__VA_ARGS__); VM_NEXT(2) \
+    VM_H(2,o) *sp++=r1; r1=r0; r0=(__VA_ARGS__); VM_NEXT(2)
+#define VM_POP(o,...) \
+    VM_H(0,o){ const int64_t v=*--sp; __VA_ARGS__; } VM_NEXT(0) \
+    VM_H(1,o){ const int64_t v=r0; __VA_ARGS__; } VM_NEXT(0) \
+    VM_H(2,o){ const int64_t v=r0; r0=r1; __VA_ARGS__; } VM_NEXT(1)
+#define VM_UN(o,...) \
+    VM_H(0,o){ const int64_t v=*--sp; r0=(__VA_ARGS__); } VM_NEXT(1) \
+    VM_H(1,o){ const int64_t v=r0; r0=(__VA_ARGS__); } VM_NEXT(1) \
+    VM_H(2,o){ const int64_t v=r0; r0=(__VA_ARGS__); } VM_NEXT(2)
+#define VM_BIN(o,...) \
+    VM_H(0,o){ const int64_t rb=*--sp, ra=*--sp; r0=(__VA_ARGS__); } VM_NEXT(1) \
+    VM_H(1,o){ const int64_t rb=r0, ra=*--sp; r0=(__VA_ARGS__); } VM_NEXT(1) \
+    VM_H(2,o){ const int64_t rb=r0, ra=r1; r0=(__VA_ARGS__); } VM_NEXT(1)
+#define VM_JCMP(o,cond) \
+    VM_H(0,o){ const int64_t rb=*--sp, ra=*--sp; if(!(cond)) ip=I->tgt; } VM_NEXT(0) \
+    VM_H(1,o){ const int64_t rb=r0, ra=*--sp; if(!(cond)) ip=I->tgt; } VM_NEXT(0) \
+    VM_H(2,o){ const int64_t rb=r0, ra=r1; if(!(cond)) ip=I->tgt; } VM_NEXT(0)
+#define VM_KEEP(o,...) \
+    VM_H(0,o){ __VA_ARGS__; } VM_NEXT(0) \
+    VM_H(1,o){ __VA_ARGS__; } VM_NEXT(1) \
+    VM_H(2,o){ __VA_ARGS__; } VM_NEXT(2)
+    // spill the cache, then run on the memory stack
+#define VM_SPILL(o,...) \
+    VM_H(0,o){ __VA_ARGS__; } VM_NEXT(0) \
+    VM_H(1,o){ *sp++=r0; __VA_ARGS__; } VM_NEXT(0) \
+    VM_H(2,o){ sp[0]=r1; sp[1]=r0; sp+=2; __VA_ARGS__; } VM_NEXT(0)
+    // arguments still cached go straight into the callee's frame; cached
+    // values under the arguments are spilled
+#define VM_CALL(s) VM_H(s,CALL){ \
+        const CodeFunc& f=fn[I->a]; const uint32_t n=f.params, c= s<n? s : n; \
+        if(s==2 && n<2){ *sp++=r1; if(n==0) *sp++=r0; } else if(s==1 && n==0) *sp++=r0; \
+        if(calls.size()>=kMaxCallDepth) throw std::runtime_error("VM call stack overflow"); \
+        calls.push_back({ip,fp,top}); \
+        fp=top; top=fp+f.slots; \
+        if(top>frames.size()) frames.resize(std::max<size_t>(top,frames.size()*2));   /* amortized: not per call */ \
+        locals=frames.data()+fp; \
+        std::fill(locals+n,locals+f.slots,0); \
+        sp-=n-c; std::copy(sp,sp+(n-c),locals); \
+        if(c>=1) locals[n-1]=r0; \
+        if(c==2) locals[n-2]=r1; \
+        if(stackCap-(size_t)(sp-stack.get())<f.maxStack) sp=grow_stack(sp,f.maxStack); \
+        ip=I->tgt; \
+    } VM_NEXT(0)
+#define VM_LOADK(k) VM_PUSH(LOAD_LOCAL_##k,locals[k])
+#define VM_STOREK(k) VM_POP(STORE_LOCAL_##k,locals[k]=v)
+
+    template<bool Profile,bool Threaded> int64_t run(){
+        const DInstr* ip=code.data(); const DInstr* I=ip; uint8_t op=0, prev=0;
+        uint32_t fp=0, top=fn.empty()? 0 : fn[0].slots;   // current frame: frames[fp, top)
+        int64_t* locals=frames.data();
+        int64_t* sp=stack.get();             // next free operand slot
+        int64_t r0=0, r1=0; unsigned st=0;   // cached top of stack; st: state<<8, for the switch
+#if PARASHADE_THREADED
+        const void* disp[3*256];
+        for(auto& d:disp) d=&&L_bad;
+#define VM_DISP(o) disp[o]=&&L0_##o; disp[256|o]=&&L1_##o; disp[512|o]=&&L2_##o;
+        VM_OPS(VM_DISP)
+#undef VM_DISP
+#endif
         for(;;){
-            if(ip>=b.size()) throw std::runtime_error("VM OOB");
-            switch((Op)b[ip++]){
-                case PUSH_IMM64:{ auto v=get_u64(ip); stack.push_back((int64_t)v);} break;
-                case LOAD_LOCAL:{ auto idx=get_u16(ip); stack.push_back(locals[idx]); } break;
-                case STORE_LOCAL:{ auto idx=get_u16(ip); auto v=stack.back(); stack.pop_back(); locals[idx]=v; } break;
-                case DUP:{ auto v=stack.back(); stack.push_back(v);} break;
-                case ADD:{ auto rb=stack.back(); stack.pop_back(); auto ra=stack.back(); stack.pop_back(); stack.push_back(ra+rb);} break;
-                case MAX_:{ auto rb=stack.back(); stack.pop_back(); auto ra=stack.back(); stack.pop_back(); stack.push_back( (ra>rb)?ra:rb ); } break;
-                case MIN_:{ auto rb=stack.back(); stack.pop_back(); auto ra=stack.back(); stack.pop_back(); stack.push_back( (ra<rb)?ra:rb ); } break;
-                case CMP_GT:{ auto rb=stack.back(); stack.pop_back(); auto ra=stack.back(); stack.pop_back(); stack.push_back( (ra>rb)?1:0 ); } break;
-                case CMP_LT:{ auto rb=stack.back(); stack.pop_back(); auto ra=stack.back(); stack.pop_back(); stack.push_back( (ra<rb)?1:0 ); } break;
-                case CMP_EQ:{ auto rb=stack.back(); stack.pop_back(); auto ra=stack.back(); stack.pop_back(); stack.push_back( (ra==rb)?1:0 ); } break;
-                case CMP_NE:{ auto rb=stack.back(); stack.pop_back(); auto ra=stack.back(); stack.pop_back(); stack.push_back( (ra!=rb)?1:0 ); } break;
-                case CMP_GE:{ auto rb=stack.back(); stack.pop_back(); auto ra=stack.back(); stack.pop_back(); stack.push_back( (ra>=rb)?1:0 ); } break;
-                case CMP_LE:{ auto rb=stack.back(); stack.pop_back(); auto ra=stack.back(); stack.pop_back(); stack.push_back( (ra<=rb)?1:0 ); } break;
-                case ARR_NEW:{ auto len=stack.back(); stack.pop_back(); if(len<0) len=0; arrays.push_back(std::vector<int64_t>((size_t)len,0)); int64_t id=(int64_t)arrays.size(); stack.push_back(id); } break;
-                case ARR_GET:{ auto idx=stack.back(); stack.pop_back(); auto id=stack.back(); stack.pop_back(); int64_t v=0; if(id>0 && (size_t)id<=arrays.size()){ auto& a=arrays[(size_t)id-1]; if(idx>=0 && (size_t)idx<a.size()) v=a[(size_t)idx]; } stack.push_back(v); } break;
-                case ARR_SET:{ auto v=stack.back(); stack.pop_back(); auto idx=stack.back(); stack.pop_back(); auto id=stack.back(); stack.pop_back(); if(id>0 && (size_t)id<=arrays.size()){ auto& a=arrays[(size_t)id-1]; if(idx>=0 && (size_t)idx<a.size()) a[(size_t)idx]=v; } stack.push_back(id); } break;
-                case JZ_ABS:{ auto tgt=get_u32(ip); auto v=stack.back(); stack.pop_back(); if(v==0) ip=tgt; } break;
-                case JMP_ABS:{ auto tgt=get_u32(ip); ip=tgt; } break;
-                case RET:{ auto v=stack.back(); return v; }
+            VM_FETCH
+            switch(st|op){
+                VM_PUSH(PUSH_IMM64,I->imm) VM_PUSH(PUSH_IMM32,I->imm) VM_PUSH(PUSH_IMM8,I->imm) VM_PUSH(PUSH_CONST,I->imm)
+                VM_PUSH(LOAD_LOCAL,locals[I->a])
+                VM_POP(STORE_LOCAL,locals[I->a]=v)
+                VM_LOADK(0) VM_LOADK(1) VM_LOADK(2) VM_LOADK(3) VM_LOADK(4) VM_LOADK(5) VM_LOADK(6) VM_LOADK(7)
+                VM_STOREK(0) VM_STOREK(1) VM_STOREK(2) VM_STOREK(3) VM_STOREK(4) VM_STOREK(5) VM_STOREK(6) VM_STOREK(7)
+                VM_H(0,DUP) r0=r1=*--sp; VM_NEXT(2)
+                VM_H(1,DUP) r1=r0; VM_NEXT(2)
+                VM_H(2,DUP) *sp++=r1; r1=r0; VM_NEXT(2)
+                VM_BIN(ADD,(int64_t)((uint64_t)ra+(uint64_t)rb))
+                VM_BIN(MAX_,(ra>rb)?ra:rb)
+                VM_BIN(MIN_,(ra<rb)?ra:rb)
+                VM_BIN(CMP_GT,(ra>rb)?1:0)
+                VM_BIN(CMP_LT,(ra<rb)?1:0)
+                VM_BIN(CMP_EQ,(ra==rb)?1:0)
+                VM_BIN(CMP_NE,(ra!=rb)?1:0)
+                VM_BIN(CMP_GE,(ra>=rb)?1:0)
+                VM_BIN(CMP_LE,(ra<=rb)?1:0)
+                VM_SPILL(ARR_NEW,sp[-1]=heap.alloc(sp[-1]))
+                VM_SPILL(ARR_GET,auto idx=*--sp; sp[-1]=heap.get(sp[-1],idx))
+                VM_SPILL(ARR_SET,auto v=*--sp; auto idx=*--sp; heap.set(sp[-1],idx,v))
+                VM_POP(JZ_ABS,if(v==0) ip=I->tgt)
+                VM_KEEP(JMP_ABS,ip=I->tgt)
+                VM_PUSH(ADD_LL,(int64_t)((uint64_t)locals[I->a]+(uint64_t)locals[I->x]))
+                VM_UN(ADD_IMM,(int64_t)((uint64_t)v+(uint64_t)I->imm))
+                VM_KEEP(STORE_IMM,locals[I->a]=I->imm)
+                VM_JCMP(JCMP_GT,ra>rb)
+                VM_JCMP(JCMP_LT,ra<rb)
+                VM_JCMP(JCMP_EQ,ra==rb)
+                VM_JCMP(JCMP_NE,ra!=rb)
+                VM_JCMP(JCMP_GE,ra>=rb)
+                VM_JCMP(JCMP_LE,ra<=rb)
+                VM_CALL(0) VM_CALL(1) VM_CALL(2)
+                // the result goes back to the caller in r0. A verified RET
+                // has only its result on the stack, so S2 cannot happen; its
+                // handler exists only to fill the table
+                VM_H(0,RET) r0=*--sp; goto ret;
+                VM_H(2,RET) *sp++=r1; goto ret;
+                VM_H(1,RET) ret:{
+                    if(calls.empty()) return r0;
+                    const Call& c=calls.back(); ip=c.ret; fp=c.fp; top=c.top; calls.pop_back();
+                    locals=frames.data()+fp;
+                } VM_NEXT(1)
+#if PARASHADE_THREADED
+                L_bad:
+#endif
+                default: throw std::runtime_error("VM bad opcode");
+            }
+        }
+    }
+#undef VM_OPS
+#undef VM_FETCH
+#undef VM_H
+#undef VM_NEXT
+#undef VM_PUSH
+#undef VM_POP
+#undef VM_UN
+#undef VM_BIN
+#undef VM_JCMP
+#undef VM_KEEP
+#undef VM_SPILL
+#undef VM_CALL
+#undef VM_LOADK
+#undef VM_STOREK
+};
+
+// ----------------- Register IR + VM (--vm=reg)
+// Three-address form of Code::seq. The register file is
+//   [locals | temporaries | constants]
+// so every operand is a plain register index: temporary k holds stack depth k
+// at block boundaries, constants are preloaded and never written. Value ops
+// write `a` from `b`,`c`; ARR_SET stores c into b of handle a; jumps test a,b
+// and go to c. R_JNxx jump when the compare is false, like JCMP_xx. Each
+// function has its own register file (a window on a contiguous register
+// stack); R_CALL a,f,c copies f's arguments from registers c.. into the new
+// window's first locals, and f's R_RET writes the result to the caller's a.
+enum ROp: uint8_t {
+    R_MOV, R_ADD, R_MAX, R_MIN, R_GT, R_LT, R_EQ, R_NE, R_GE, R_LE,
+    R_ARR_NEW, R_ARR_GET, R_ARR_SET,
+    R_JMP, R_JZ, R_JNGT, R_JNLT, R_JNEQ, R_JNNE, R_JNGE, R_JNLE, R_RET, R_CALL
+};
+struct RInstr{ ROp op; uint32_t a=0,b=0,c=0; };
+struct RegFunc{
+    uint32_t entry=0, params=0;         // first instruction in RegCode::code; arguments
+    std::vector<int64_t> init;          // initial register file (constants filled in)
+    uint32_t nLocals=0, nTemps=0;
+};
+struct RegCode{
+    std::vector<RInstr> code;
+    std::vector<RegFunc> funcs;         // by function id, as in Code::funcs
+};
+
+// One pass over Code::seq with a virtual operand stack: loads and pushes only
+// name their register, an op writes a temporary, and `STORE x` right after
+// the op that made its value retargets that op to x. The virtual stack is
+// spilled to its canonical temporaries before every branch and at every jump
+// target, so all paths into a block agree on where the values are.
+class RegTranslator{
+    static constexpr uint32_t TEMP=1u<<30, KONST=1u<<31;
+    const Code& C; RegCode R; RegFunc* F=nullptr;
+    std::vector<uint32_t> V;            // virtual stack: tagged register per depth
+    std::unordered_map<uint64_t,uint32_t> kIdx; std::vector<int64_t> kvals;
+    int lastDef=-1;                     // op in the current block whose `a` is V.back()
+
+    uint32_t konst(uint64_t v){ auto it=kIdx.emplace(v,(uint32_t)kvals.size()); if(it.second) kvals.push_back((int64_t)v); return KONST|it.first->second; }
+    uint32_t temp(size_t depth){ F->nTemps=std::max(F->nTemps,(uint32_t)depth+1); return TEMP|(uint32_t)depth; }
+    uint32_t pop(){ uint32_t v=V.back(); V.pop_back(); return v; }
+    void emit(ROp op,uint32_t a,uint32_t b=0,uint32_t c=0){ R.code.push_back({op,a,b,c}); lastDef=-1; }
+    void def(ROp op,uint32_t b,uint32_t c=0){ uint32_t d=temp(V.size()); emit(op,d,b,c); lastDef=(int)R.code.size()-1; V.push_back(d); }
+    void spill(){
+        for(size_t k=0;k<V.size();++k) if(V[k]!=(TEMP|(uint32_t)k)){ emit(R_MOV,temp(k),V[k]); V[k]=TEMP|(uint32_t)k; }
+        lastDef=-1;
+    }
+    void store(uint32_t x,uint32_t v){
+        // values still on the stack that name x must keep the old value
+        bool aliased=false;
+        for(size_t k=0;k<V.size();++k) if(V[k]==x){ emit(R_MOV,temp(k),x); V[k]=TEMP|(uint32_t)k; aliased=true; }
+        if(!aliased && lastDef>=0 && R.code[(size_t)lastDef].a==v){
+            R.code[(size_t)lastDef].a=x;
+            for(auto& e: V) if(e==v) e=x;  // DUP'd copies now live in x
+        } else emit(R_MOV,x,v);
+        lastDef=-1;
+    }
+    int effect(const IRInstr& I) const { return stack_effect(I,C.funcs); }
+
+public:
+    explicit RegTranslator(const Code& c):C(c){}
+
+    RegCode run(){
+        const size_t n=C.seq.size();
+        std::vector<uint32_t> startOf(n+1,0);
+        R.funcs.resize(C.funcs.size());
+        for(size_t k=0;k<C.funcs.size();++k){
+            size_t end= k+1<C.funcs.size()? C.funcs[k+1].entry : n;
+            translate(C.funcs[k],end,R.funcs[k],startOf);
+        }
+        return std::move(R);
+    }
+
+    // one function: seq[f.entry, end)
+    void translate(const CodeFunc& cf,size_t end,RegFunc& rf,std::vector<uint32_t>& startOf){
+        const auto& seq=C.seq; const size_t b0=cf.entry, n=end;
+        F=&rf; rf.entry=(uint32_t)R.code.size(); rf.params=cf.params; rf.nLocals=cf.slots;
+        V.clear(); kIdx.clear(); kvals.clear(); lastDef=-1;
+        // stack depth on entry to each reachable instruction
+        std::vector<int> depth(n+1,-1); std::vector<uint8_t> isTarget(n+1,0);
+        std::vector<size_t> work; if(n>b0){ depth[b0]=0; work.push_back(b0); }
+        while(!work.empty()){
+            size_t i=work.back(); work.pop_back();
+            const auto& I=seq[i]; int d=depth[i]+effect(I);
+            if(d<0) throw std::runtime_error("register IR: stack underflow");
+            auto reach=[&](size_t t){ if(t<b0 || t>n) throw std::runtime_error("register IR: bad jump target"); if(depth[t]<0){ depth[t]=d; if(t<n) work.push_back(t); } else if(depth[t]!=d) throw std::runtime_error("register IR: stack depth mismatch at join"); };
+            if(I.hasTarget){ isTarget[(size_t)I.target]=1; reach((size_t)I.target); }
+            if(falls_through(I.op)) reach(i+1);
+        }
+
+        bool live=false;
+        for(size_t i=b0;i<n;++i){
+            const auto& I=seq[i];
+            if(isTarget[i]){
+                if(live) spill();
+                V.clear(); for(int k=0;k<depth[i];++k) V.push_back(temp((size_t)k));
+            }
+            startOf[i]=(uint32_t)R.code.size();
+            if(depth[i]<0){ live=false; continue; }   // unreachable
+            live=falls_through(I.op);
+            const Op op=I.op;
+            switch(op){
+                case PUSH_IMM64: case PUSH_IMM32: case PUSH_IMM8: case PUSH_CONST: V.push_back(konst(I.imm)); lastDef=-1; break;
+                case LOAD_LOCAL: V.push_back(I.idx); lastDef=-1; break;
+                case STORE_LOCAL: store(I.idx,pop()); break;
+                case DUP: V.push_back(V.back()); lastDef=-1; break;
+                case ADD: case MAX_: case MIN_:
+                case CMP_GT: case CMP_LT: case CMP_EQ: case CMP_NE: case CMP_GE: case CMP_LE:{
+                    uint32_t b=pop(), a=pop();
+                    ROp r= op==ADD? R_ADD : op==MAX_? R_MAX : op==MIN_? R_MIN : (ROp)(R_GT+(op-CMP_GT));
+                    def(r,a,b);
+                } break;
+                case ADD_LL: def(R_ADD,I.idx,I.idx2); break;
+                case ADD_IMM:{ uint32_t a=pop(); def(R_ADD,a,konst(I.imm)); } break;
+                case STORE_IMM: store(I.idx,konst(I.imm)); break;
+                case ARR_NEW:{ uint32_t a=pop(); def(R_ARR_NEW,a); } break;
+                case ARR_GET:{ uint32_t i2=pop(), h=pop(); def(R_ARR_GET,h,i2); } break;
+                case ARR_SET:{ uint32_t v=pop(), i2=pop(), h=pop(); emit(R_ARR_SET,h,i2,v); V.push_back(h); } break;
+                case JZ_ABS:{ uint32_t c=pop(); spill(); emit(R_JZ,c,0,(uint32_t)I.target); } break;
+                case JCMP_GT: case JCMP_LT: case JCMP_EQ: case JCMP_NE: case JCMP_GE: case JCMP_LE:{
+                    uint32_t b=pop(), a=pop(); spill(); emit((ROp)(R_JNGT+(op-JCMP_GT)),a,b,(uint32_t)I.target);
+                } break;
+                case JMP_ABS: spill(); emit(R_JMP,0,0,(uint32_t)I.target); break;
+                case RET: emit(R_RET,pop()); break;
+                case CALL:{
+                    // arguments into consecutive temporaries; the callee has
+                    // its own registers, so nothing else needs spilling
+                    size_t d0=V.size()-C.funcs[I.idx].params;
+                    for(size_t k=d0;k<V.size();++k) if(V[k]!=(TEMP|(uint32_t)k)){ emit(R_MOV,temp(k),V[k]); V[k]=TEMP|(uint32_t)k; }
+                    V.resize(d0); def(R_CALL,I.idx,temp(d0));
+                } break;
+                default:
+                    if(op>=LOAD_LOCAL_0 && op<=LOAD_LOCAL_7){ V.push_back(op-LOAD_LOCAL_0); lastDef=-1; }
+                    else if(op>=STORE_LOCAL_0 && op<=STORE_LOCAL_7) store(op-STORE_LOCAL_0,pop());
+                    else throw std::runtime_error("register IR: unhandled opcode "+string(op_name(op)));
+            }
+        }
+        startOf[n]=(uint32_t)R.code.size();
+
+        // resolve tags and jump targets
+        const uint32_t tempBase=rf.nLocals, konstBase=rf.nLocals+rf.nTemps;
+        auto reg=[&](uint32_t r){ return (r&KONST)? konstBase+(r&~KONST) : (r&TEMP)? tempBase+(r&~TEMP) : r; };
+        for(size_t k=rf.entry;k<R.code.size();++k){
+            RInstr& I=R.code[k];
+            I.a=reg(I.a);
+            if(I.op>=R_JMP && I.op<=R_JNLE){ I.b=reg(I.b); I.c=startOf[I.c]; }
+            else if(I.op==R_CALL) I.c=reg(I.c);
+            else{ I.b=reg(I.b); I.c=reg(I.c); }
+        }
+        rf.init.assign(konstBase,0); rf.init.insert(rf.init.end(),kvals.begin(),kvals.end());
+    }
+};
+
+static RegCode to_register_ir(const Code& c){ return RegTranslator(c).run(); }
+
+static string reg_listing(const RegCode& R){
+    static const char* names[]={"mov","add","max","min","gt","lt","eq","ne","ge","le","arr_new","arr_get","arr_set",
+                                "jmp","jz","jngt","jnlt","jneq","jnne","jnge","jnle","ret","call"};
+    std::ostringstream o;
+    for(size_t k=0;k<R.funcs.size();++k){
+        const RegFunc& F=R.funcs[k];
+        size_t end= k+1<R.funcs.size()? R.funcs[k+1].entry : R.code.size();
+        auto rn=[&](uint32_t r){
+            if(r<F.nLocals) return "l"+std::to_string(r);
+            if(r<F.nLocals+F.nTemps) return "t"+std::to_string(r-F.nLocals);
+            return "#"+std::to_string(F.init[r]);
+        };
+        if(R.funcs.size()>1) o<<"fn"<<k<<":\n";
+        for(size_t i=F.entry;i<end;++i){
+            const auto& I=R.code[i];
+            o<<std::setw(4)<<i<<"  "<<std::left<<std::setw(8)<<names[I.op]<<std::right;
+            switch(I.op){
+                case R_MOV: case R_ARR_NEW: o<<rn(I.a)<<", "<<rn(I.b); break;
+                case R_JMP: o<<"@"<<I.c; break;
+                case R_JZ: o<<rn(I.a)<<", @"<<I.c; break;
+                case R_RET: o<<rn(I.a); break;
+                case R_CALL: o<<rn(I.a)<<", fn"<<I.b<<"("<<rn(I.c)<<"..)"; break;
+                default:
+                    if(I.op>=R_JNGT) o<<rn(I.a)<<", "<<rn(I.b)<<", @"<<I.c;
+                    else o<<rn(I.a)<<", "<<rn(I.b)<<", "<<rn(I.c);
+            }
+            o<<"\n";
+        }
+    }
+    return o.str();
+}
+
+// Interpreter for RegCode: operands are read straight from the register file.
+// Each call gets a fresh window on `r` (init, then the arguments); windows
+// are addressed through R, which is re-derived after any growth of `r`.
+struct RegVM{
+    struct Call{ size_t pc, base; uint32_t dest; };
+    const RegCode& rc; std::vector<int64_t> r; std::vector<Call> calls; ArrayHeap heap;
+    explicit RegVM(const RegCode& c):rc(c),r(c.funcs[0].init){ r.resize(std::max<size_t>(r.size(),1024)); }
+
+    int64_t run_all(){
+        const RInstr* code=rc.code.data(); const size_t n=rc.code.size();
+        size_t base=0, top=rc.funcs[0].init.size(); int64_t* R=r.data();
+        for(size_t pc=rc.funcs[0].entry;;){
+            if(pc>=n) throw std::runtime_error("VM OOB");
+            const RInstr& I=code[pc++];
+            switch(I.op){
+                case R_MOV: R[I.a]=R[I.b]; break;
+                case R_ADD: R[I.a]=(int64_t)((uint64_t)R[I.b]+(uint64_t)R[I.c]); break;
+                case R_MAX:{ int64_t x=R[I.b], y=R[I.c]; R[I.a]=x>y? x:y; } break;
+                case R_MIN:{ int64_t x=R[I.b], y=R[I.c]; R[I.a]=x<y? x:y; } break;
+                case R_GT: R[I.a]=R[I.b]>R[I.c]; break;
+                case R_LT: R[I.a]=R[I.b]<R[I.c]; break;
+                case R_EQ: R[I.a]=R[I.b]==R[I.c]; break;
+                case R_NE: R[I.a]=R[I.b]!=R[I.c]; break;
+                case R_GE: R[I.a]=R[I.b]>=R[I.c]; break;
+                case R_LE: R[I.a]=R[I.b]<=R[I.c]; break;
+                case R_ARR_NEW: R[I.a]=heap.alloc(R[I.b]); break;
+                case R_ARR_GET: R[I.a]=heap.get(R[I.b],R[I.c]); break;
+                case R_ARR_SET: heap.set(R[I.a],R[I.b],R[I.c]); break;
+                case R_JMP: pc=I.c; break;
+                case R_JZ: if(R[I.a]==0) pc=I.c; break;
+                case R_JNGT: if(!(R[I.a]>R[I.b])) pc=I.c; break;
+                case R_JNLT: if(!(R[I.a]<R[I.b])) pc=I.c; break;
+                case R_JNEQ: if(!(R[I.a]==R[I.b])) pc=I.c; break;
+                case R_JNNE: if(!(R[I.a]!=R[I.b])) pc=I.c; break;
+                case R_JNGE: if(!(R[I.a]>=R[I.b])) pc=I.c; break;
+                case R_JNLE: if(!(R[I.a]<=R[I.b])) pc=I.c; break;
+                case R_CALL:{
+                    const RegFunc& F=rc.funcs[I.b];
+                    if(calls.size()>=kMaxCallDepth) throw std::runtime_error("VM call stack overflow");
+                    size_t nb=top, nt=nb+F.init.size();
+                    if(nt>r.size()){ r.resize(std::max(nt,r.size()*2)); R=r.data()+base; }
+                    int64_t* W=r.data()+nb;
+                    std::copy(F.init.begin(),F.init.end(),W);
+                    for(uint32_t k=0;k<F.params;++k) W[k]=R[I.c+k];
+                    calls.push_back({pc,base,I.a});
+                    base=nb; top=nt; R=W; pc=F.entry;
+                } break;
+                case R_RET:{
+                    int64_t v=R[I.a];
+                    if(calls.empty()) return v;
+                    Call c=calls.back(); calls.pop_back();
+                    top=base; base=c.base; R=r.data()+base; pc=c.pc; R[c.dest]=v;
+                } break;
                 default: throw std::runtime_error("VM bad opcode");
             }
         }
@@ -524,32 +2752,48 @@ struct NASM{
         auto lab=mkLabel(); auto res=labelForInstr.emplace(instrIndex,lab);
         return res.first->second;
     }
-    // Windows x64 prologue with proper alignment + heap init
-    void prologue(int locals, bool needsHeap){
+    void header(){
         asmtext<<"default rel\nextern ExitProcess\nextern GetProcessHeap\nextern HeapAlloc\n";
         asmtext<<"section .text\n";
         asmtext<<"global main\n";
-        asmtext<<"main:\n";
+    }
+    static string fnLabel(size_t k){ return k? "parashade_fn_"+std::to_string(k) : string("main"); }
+    // Windows x64 prologue with proper alignment + heap init (entry scope) or
+    // argument copy (other scopes: args were pushed left to right, so arg k of
+    // n sits at [rbp+16+(n-1-k)*8]); the whole frame starts out zeroed
+    void prologue(size_t fn, int locals, int params, bool needsHeap){
+        asmtext<<fnLabel(fn)<<":\n";
         asmtext<<"    push rbp\n";
         asmtext<<"    mov rbp, rsp\n";
         int shadow=32;
         int reserve = locals*8 + shadow;
         reserve = (reserve + 15) & ~15; // align to 16
         asmtext<<"    sub rsp, "<<reserve<<"\n";
-        if(needsHeap){
+        if(locals){
+            // volatile registers only (rep stosq would clobber rdi, callee-saved on Win64)
+            const string zl=mkLabel();
+            asmtext<<"    xor eax, eax\n    lea rdx, [rbp - "<<locals*8<<"]\n    mov ecx, "<<locals<<"\n"
+                   <<zl<<":\n    mov [rdx + rcx*8 - 8], rax\n    dec ecx\n    jnz "<<zl<<"\n";
+        }
+        for(int k=0;k<params;++k)
+            asmtext<<"    mov rax, [rbp + "<<16+(params-1-k)*8<<"]\n    mov [rbp - "<<(k+1)*8<<"], rax\n";
+        if(fn==0 && needsHeap){
             // RCX...; call GetProcessHeap -> RAX, save in r12 (non-volatile)
             asmtext<<"    call GetProcessHeap\n";
             asmtext<<"    mov r12, rax\n";
         }
     }
-    void epilogue(){
-        asmtext<<"    mov ecx, eax\n";
-        asmtext<<"    call ExitProcess\n";
-    }
     void placeLabel(const string& L){ asmtext<<L<<":\n"; }
 
     // stack helpers
     void op_push_imm(uint64_t v){ asmtext<<"    mov rax, 0x"<<std::hex<<v<<std::dec<<"\n    push rax\n"; }
+    void op_push_imm32(int64_t v){ asmtext<<"    push qword "<<v<<"\n"; } // sign-extended imm8/imm32
+    void op_push_const(int idx){ asmtext<<"    push qword [rel parashade_consts + "<<idx*8<<"]\n"; }
+    void const_pool(const std::vector<uint64_t>& K){
+        if(K.empty()) return;
+        asmtext<<"section .rdata\nalign 8\nparashade_consts:\n";
+        for(auto v: K) asmtext<<"    dq 0x"<<std::hex<<v<<std::dec<<"\n";
+    }
     void op_dup(){ asmtext<<"    mov rax, [rsp]\n    push rax\n"; }
     void op_load_local(int idx){ int off=(idx+1)*8; asmtext<<"    mov rax, [rbp - "<<off<<"]\n    push rax\n"; }
     void op_store_local(int idx){ int off=(idx+1)*8; asmtext<<"    pop rax\n    mov [rbp - "<<off<<"], rax\n"; }
@@ -559,9 +2803,24 @@ struct NASM{
     void op_cmp_setcc(const char* cc){ // push 0/1
         asmtext<<"    pop rbx\n    pop rax\n    cmp rax, rbx\n    set"<<cc<<" al\n    movzx rax, al\n    push rax\n";
     }
-    void op_ret(){ asmtext<<"    pop rax\n"; }
+    void op_ret(size_t fn){
+        asmtext<<"    pop rax\n";
+        if(fn){ asmtext<<"    leave\n    ret\n"; return; }
+        asmtext<<"    mov ecx, eax\n    call ExitProcess\n";
+    }
+    void op_call(size_t fn,uint32_t params){
+        asmtext<<"    call "<<fnLabel(fn)<<"\n";
+        if(params) asmtext<<"    add rsp, "<<params*8<<"\n";
+        asmtext<<"    push rax\n";
+    }
     void op_jz(const string& L){ asmtext<<"    pop rax\n    test rax, rax\n    jz "<<L<<"\n"; }
     void op_jmp(const string& L){ asmtext<<"    jmp "<<L<<"\n"; }
+    void op_add_ll(int a,int b){ asmtext<<"    mov rax, [rbp - "<<(a+1)*8<<"]\n    add rax, [rbp - "<<(b+1)*8<<"]\n    push rax\n"; }
+    void op_add_imm(int64_t v){ asmtext<<"    pop rax\n    add rax, "<<v<<"\n    push rax\n"; }
+    void op_store_imm(int idx,int64_t v){ asmtext<<"    mov qword [rbp - "<<(idx+1)*8<<"], "<<v<<"\n"; }
+    void op_jcmp(const char* jfalse, const string& L){ // jump when the compare is false
+        asmtext<<"    pop rbx\n    pop rax\n    cmp rax, rbx\n    "<<jfalse<<" "<<L<<"\n";
+    }
 
     // arrays: r12 holds process heap handle
     void op_arr_new(){
@@ -610,28 +2869,41 @@ struct NASM{
     }
 };
 
-static void emit_nasm_pe(const Code& code, int localCount, const string& outdir){
+static void emit_nasm_pe(const Code& code, const string& outdir){
     // Determine if arrays are used to add heap init
     bool needsHeap=false;
     for(auto& I: code.seq) if(I.op==ARR_NEW||I.op==ARR_GET||I.op==ARR_SET) { needsHeap=true; break; }
 
     NASM n;
-    n.prologue(localCount, needsHeap);
+    n.header();
 
     // Mark labels for branch targets
     for(size_t i=0;i<code.seq.size();++i){
         const auto& I=code.seq[i];
-        if((I.op==JZ_ABS||I.op==JMP_ABS) && I.hasTarget) n.ensureLabel(I.target);
+        if(I.hasTarget) n.ensureLabel(I.target);
     }
 
-    // Emit instructions and labels
+    // Emit instructions and labels, one function after another
+    size_t fn=0;
     for(size_t i=0;i<code.seq.size();++i){
+        while(fn<code.funcs.size() && code.funcs[fn].entry==i){
+            const CodeFunc& F=code.funcs[fn];
+            n.prologue(fn,(int)F.slots,(int)F.params,needsHeap); ++fn;
+        }
         if(n.labelForInstr.count((int)i)) n.placeLabel(n.labelForInstr[(int)i]);
         const auto& I=code.seq[i];
         switch(I.op){
             case PUSH_IMM64: n.op_push_imm(I.imm); break;
+            case PUSH_IMM32: case PUSH_IMM8: n.op_push_imm32((int64_t)I.imm); break;
+            case PUSH_CONST: n.op_push_const(I.idx); break;
             case LOAD_LOCAL: n.op_load_local(I.idx); break;
             case STORE_LOCAL: n.op_store_local(I.idx); break;
+            case LOAD_LOCAL_0: case LOAD_LOCAL_1: case LOAD_LOCAL_2: case LOAD_LOCAL_3:
+            case LOAD_LOCAL_4: case LOAD_LOCAL_5: case LOAD_LOCAL_6: case LOAD_LOCAL_7:
+                n.op_load_local(I.op-LOAD_LOCAL_0); break;
+            case STORE_LOCAL_0: case STORE_LOCAL_1: case STORE_LOCAL_2: case STORE_LOCAL_3:
+            case STORE_LOCAL_4: case STORE_LOCAL_5: case STORE_LOCAL_6: case STORE_LOCAL_7:
+                n.op_store_local(I.op-STORE_LOCAL_0); break;
             case DUP: n.op_dup(); break;
             case ADD: n.op_add(); break;
             case MAX_: n.op_max(); break;
@@ -653,12 +2925,21 @@ static void emit_nasm_pe(const Code& code, int localCount, const string& outdir)
                 string L = n.ensureLabel(I.target);
                 n.op_jmp(L);
             } break;
-            case RET: n.op_ret(); goto end_emit;
+            case ADD_LL: n.op_add_ll(I.idx,I.idx2); break;
+            case ADD_IMM: n.op_add_imm((int64_t)I.imm); break;
+            case STORE_IMM: n.op_store_imm(I.idx,(int64_t)I.imm); break;
+            case JCMP_GT: n.op_jcmp("jle",n.ensureLabel(I.target)); break;
+            case JCMP_LT: n.op_jcmp("jge",n.ensureLabel(I.target)); break;
+            case JCMP_EQ: n.op_jcmp("jne",n.ensureLabel(I.target)); break;
+            case JCMP_NE: n.op_jcmp("je",n.ensureLabel(I.target)); break;
+            case JCMP_GE: n.op_jcmp("jl",n.ensureLabel(I.target)); break;
+            case JCMP_LE: n.op_jcmp("jg",n.ensureLabel(I.target)); break;
+            case CALL: n.op_call(I.idx,code.funcs[I.idx].params); break;
+            case RET: n.op_ret(fn-1); break;
             default: throw std::runtime_error("NASM emitter: bad opcode");
         }
     }
-end_emit:
-    n.epilogue();
+    n.const_pool(code.consts);
 
     // write files
 #ifdef _WIN32
@@ -694,71 +2975,403 @@ static string hex_dump(const std::vector<uint8_t>& v){
     return o.str();
 }
 
-static string meta_json(const Module& m, const Typer& T, const Emitter& E){
-    // locals sorted by index
-    std::vector<const Local*> locs; locs.reserve(T.locals.size());
-    for(auto& kv:T.locals) locs.push_back(&kv.second);
-    std::sort(locs.begin(),locs.end(),[](auto* a, auto* b){ return a->index<b->index; });
-
+static string meta_json(const Module& m, const ModuleBuild& B){
+    const Code& code=B.code;
     std::ostringstream s;
     s<<"{\n";
     s<<"  \"module\":\""<<m.name<<"\",\n";
-    s<<"  \"functions\":[{\"name\":\""<<m.mainFn.name<<"\",\"locals\":[";
-    for(size_t i=0;i<locs.size();++i){
-        if(i) s<<",";
-        s<<"{\"name\":\""<<locs[i]->name<<"\",\"type\":\""<<(locs[i]->ty.k==Type::Int?"int":"arr")
-         <<"\",\"index\":"<<locs[i]->index<<",\"line\":"<<locs[i]->declLine
-         <<",\"explicit\":"<<(locs[i]->explicitDeclared?"true":"false")<<"}";
-    }
-    s<<"]}],\n";
+    s<<"  \"functions\":[";
+    size_t values=0,copies=0,cse=0,deadStores=0,slots=0,before=0,after=0; bool ssa=false;
+    for(size_t k=0;k<m.funcs.size();++k){
+        const Func& F=m.funcs[k]; const Typer& T=B.T[k]; const Emitter& E=B.E[k];
+        // locals sorted by index
+        std::vector<const Local*> locs; locs.reserve(T.locals.size());
+        for(auto& l:T.locals) locs.push_back(&l);
+        s<<(k?",":"")<<"\n    {\"name\":\""<<F.name<<"\",\"id\":"<<k<<",\"params\":"<<F.params.size()<<",\"offset\":"<<code.funcs[k].offset<<",\"max_stack\":"<<code.funcs[k].maxStack
+         <<",\"frame_jit\":"<<(F.frameJit?"true":"false")<<",\"locals\":[";
+        for(size_t i=0;i<locs.size();++i){
+            if(i) s<<",";
+            s<<"{\"name\":\""<<gSyms.name(locs[i]->sym)<<"\",\"type\":\""<<(locs[i]->ty.k==Type::Int?"int":"arr")
+             <<"\",\"index\":"<<locs[i]->index<<",\"line\":"<<locs[i]->declLine
+             <<",\"explicit\":"<<(locs[i]->explicitDeclared?"true":"false")<<"}";
+        }
+        // where each value lives: one entry per emitted let with SSA slots, one per name without
+        s<<"],\"frame_slots\":"<<E.frame_slots()<<",\"slot_map\":[";
+        auto slotEntry=[&](bool comma,uint32_t sym,uint32_t line,int slot){ s<<(comma?",":"")<<"{\"name\":\""<<gSyms.name(sym)<<"\",\"line\":"<<line<<",\"slot\":"<<slot<<"}"; };
+        if(E.ssa) for(size_t i=0;i<E.S.map.size();++i) slotEntry(i>0,E.S.map[i].sym,E.S.map[i].line,E.S.map[i].slot);
+        else for(size_t i=0;i<locs.size();++i) slotEntry(i>0,locs[i]->sym,(uint32_t)locs[i]->declLine,locs[i]->index);
+        s<<"]}";
+        if(E.ssa){ ssa=true; values+=E.S.values; copies+=E.S.copies; cse+=E.S.cse; deadStores+=E.S.deadStores; slots+=E.S.nSlots; }
+        before+=E.peep.before; after+=E.peep.after;
+    }
+    s<<"],\n";
+    if(ssa) s<<"  \"ssa\":{\"values\":"<<values<<",\"copies\":"<<copies<<",\"cse\":"<<cse<<",\"dead_stores\":"<<deadStores<<",\"slots\":"<<slots<<"},\n";
+    s<<"  \"peephole\":{\"level\":"<<B.E[0].peep.level<<",\"instrs_before\":"<<before<<",\"instrs_after\":"<<after<<"},\n";
     s<<"  \"warnings\":[";
     bool first=true;
-    for(auto& w:T.warns){ if(!first) s<<","; first=false; s<<"{\"code\":\""<<w.code<<"\",\"line\":"<<w.line<<",\"msg\":\""<<w.msg<<"\"}"; }
-    for(auto& f:E.folds){ if(!first) s<<","; first=false; s<<"{\"code\":\"W100\",\"line\":"<<f.line<<",\"msg\":\""<<f.what<<"\"}"; }
+    for(auto& T:B.T) for(auto& w:T.warns){ if(!first) s<<","; first=false; s<<"{\"code\":\""<<w.code<<"\",\"line\":"<<w.line<<",\"msg\":\""<<w.msg<<"\"}"; }
+    for(auto& E:B.E) for(auto& f:E.folds){ if(!first) s<<","; first=false; s<<"{\"code\":\"W100\",\"line\":"<<f.line<<",\"msg\":\""<<f.what<<"\"}"; }
     s<<"]\n";
     s<<"}\n";
     return s.str();
 }
 
-// ----------------- Driver
-int main(int argc, char** argv){
-    std::ios::sync_with_stdio(false); std::cin.tie(nullptr);
+// .parx artifact, little-endian: "PARX", u16 version, u16 reserved, u32 function
+// count, u32 constant count, u32 code bytes, then the constant pool (u64 each),
+// the code, and per function u32 code offset, u32 params, u32 frame slots,
+// u32 max operand-stack depth (function 0 is the entry scope).
+static const uint16_t kParxVersion=3;
+static void write_parx(const string& path, const Code& code){
+    string out="PARX";
+    auto u16=[&](uint16_t v){ out.push_back(char(v&0xFF)); out.push_back(char(v>>8)); };
+    auto u32=[&](uint32_t v){ for(int i=0;i<4;i++) out.push_back(char((v>>(i*8))&0xFF)); };
+    auto u64=[&](uint64_t v){ for(int i=0;i<8;i++) out.push_back(char((v>>(i*8))&0xFF)); };
+    u16(kParxVersion); u16(0); u32((uint32_t)code.funcs.size()); u32((uint32_t)code.consts.size()); u32((uint32_t)code.bytes.size());
+    for(auto k: code.consts) u64(k);
+    out.append((const char*)code.bytes.data(),code.bytes.size());
+    for(auto& f: code.funcs){ u32(f.offset); u32(f.params); u32(f.slots); u32(f.maxStack); }
+    std::ofstream f(path,std::ios::binary); f.write(out.data(),(std::streamsize)out.size());
+    if(!f) throw std::runtime_error("cannot write '"+path+"'");
+}
 
-    bool run=false, emit=false, emit_nasm=false; string outdir=".";
-    for(int i=1;i<argc;i++){
-        string a=argv[i];
-        if(a=="--run") run=true;
-        else if(a=="--emit") emit=true;
-        else if(a=="--emit-nasm"){ emit_nasm=true; if(i+1<argc) outdir=argv[++i]; }
+// The inverse of write_parx. Only the layout is checked here; the VM verifies
+// the code itself before running it, so a damaged or hand-made file is
+// rejected either way.
+static Code read_parx(std::string_view in){
+    size_t at=0;
+    auto need=[&](size_t k){ if(in.size()-at<k) throw std::runtime_error(".parx: truncated"); };
+    auto un=[&](int w){ need((size_t)w); uint64_t v=0; for(int i=0;i<w;i++) v|=(uint64_t)(uint8_t)in[at+i]<<(i*8); at+=(size_t)w; return v; };
+    need(4); if(in.substr(0,4)!="PARX") throw std::runtime_error(".parx: bad magic"); at=4;
+    uint16_t ver=(uint16_t)un(2); un(2);
+    if(ver!=kParxVersion) throw std::runtime_error(".parx: version "+std::to_string(ver)+", expected "+std::to_string(kParxVersion));
+    Code c;
+    uint32_t nf=(uint32_t)un(4), nk=(uint32_t)un(4), nb=(uint32_t)un(4);
+    need((size_t)nk*8); for(uint32_t i=0;i<nk;i++) c.consts.push_back(un(8));
+    need(nb); c.bytes.assign((const uint8_t*)in.data()+at,(const uint8_t*)in.data()+at+nb); at+=nb;
+    need((size_t)nf*16);
+    for(uint32_t i=0;i<nf;i++){ CodeFunc f; f.offset=(uint32_t)un(4); f.params=(uint32_t)un(4); f.slots=(uint32_t)un(4); f.maxStack=(uint32_t)un(4); c.funcs.push_back(f); }
+    if(at!=in.size()) throw std::runtime_error(".parx: trailing bytes");
+    return c;
+}
+
+// ----------------- Source input
+// Read-only memory map of a source file; the front end lexes straight from the
+// mapped bytes. An empty file maps to an empty view.
+struct MappedFile{
+    const char* data=nullptr; size_t size=0;
+#ifdef _WIN32
+    HANDLE file=INVALID_HANDLE_VALUE, mapping=nullptr;
+    explicit MappedFile(const string& path){
+        file=CreateFileA(path.c_str(),GENERIC_READ,FILE_SHARE_READ,nullptr,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN,nullptr);
+        if(file==INVALID_HANDLE_VALUE) throw std::runtime_error("cannot open '"+path+"'");
+        LARGE_INTEGER sz; if(!GetFileSizeEx(file,&sz)){ CloseHandle(file); throw std::runtime_error("cannot stat '"+path+"'"); }
+        size=size_t(sz.QuadPart); if(size==0) return;
+        mapping=CreateFileMappingA(file,nullptr,PAGE_READONLY,0,0,nullptr);
+        if(mapping) data=(const char*)MapViewOfFile(mapping,FILE_MAP_READ,0,0,0);
+        if(!data){ if(mapping) CloseHandle(mapping); CloseHandle(file); throw std::runtime_error("cannot map '"+path+"'"); }
     }
+    ~MappedFile(){ if(data) UnmapViewOfFile(data); if(mapping) CloseHandle(mapping); if(file!=INVALID_HANDLE_VALUE) CloseHandle(file); }
+#else
+    explicit MappedFile(const string& path){
+        int fd=open(path.c_str(),O_RDONLY);
+        if(fd<0) throw std::runtime_error("cannot open '"+path+"'");
+        struct stat st; if(fstat(fd,&st)!=0){ close(fd); throw std::runtime_error("cannot stat '"+path+"'"); }
+        size=size_t(st.st_size);
+        if(size){
+            void* p=mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+            if(p==MAP_FAILED){ close(fd); throw std::runtime_error("cannot map '"+path+"'"); }
+            madvise(p,size,MADV_SEQUENTIAL); data=(const char*)p;
+        }
+        close(fd);
+    }
+    ~MappedFile(){ if(data) munmap((void*)data,size); }
+#endif
+    MappedFile(const MappedFile&)=delete; MappedFile& operator=(const MappedFile&)=delete;
+    std::string_view view() const { return size? std::string_view(data,size) : std::string_view(); }
+};
 
-    string src((std::istreambuf_iterator<char>(std::cin)), {});
-    string norm=normalize_longform(src);
+// ----------------- Driver
+struct DriverOptions{ bool run=false, emit=false, emit_nasm=false, build=false, unfused=false, stream=false; string outdir="."; uint64_t ctSteps=kCtEvalSteps; int optLevel=2; bool profilePairs=false, regVM=false; };
+
+// --profile-pairs: the most frequent executed opcode pairs, compact encodings
+// merged into their long forms (input data for kFusions)
+static void print_pair_profile(const std::vector<uint64_t>& pairs, const string& label){
+    std::map<std::pair<string,string>,uint64_t> byName; uint64_t total=0;
+    for(size_t i=0;i<pairs.size();++i) if(pairs[i] && (i>>8)){ byName[{op_name(uint8_t(i>>8)),op_name(uint8_t(i&0xFF))}]+=pairs[i]; total+=pairs[i]; }
+    std::vector<std::pair<uint64_t,std::pair<string,string>>> top;
+    for(auto& kv:byName) top.push_back({kv.second,kv.first});
+    std::sort(top.rbegin(),top.rend());
+    std::cerr<<"; opcode pairs"<<(label.empty()? "":" ("+label+")")<<", "<<total<<" executed\n";
+    for(size_t k=0;k<top.size() && k<10;++k)
+        std::cerr<<";   "<<std::left<<std::setw(26)<<(top[k].second.first+","+top[k].second.second)<<std::right<<std::setw(12)<<top[k].first
+                 <<"  "<<std::fixed<<std::setprecision(1)<<100.0*top[k].first/total<<"%\n";
+}
+
+// Sources at least this big are lexed in streaming mode (constant token memory).
+static const size_t kStreamLexThreshold=size_t(64)<<20;
+static const size_t kStreamLexWindow=4096;
 
+// Compile one module from `src` (mapped file or stdin buffer) and run/emit it.
+static int compile_one(std::string_view src, const DriverOptions& o, const string& outdir, const string& label){
     try{
-        Lexer L(norm); Parser P(L); Module mod=P.parseModule();
-        Typer T; Emitter E(T); E.gen_func(mod.mainFn); E.finalize_bytes();
+        // Default: fused normalize+lex straight off the source. --unfused keeps the
+        // two-stage path (materialized core text), e.g. to diff the two.
+        string norm; if(o.unfused) norm=normalize_longform(src);
+        const std::string_view lexSrc = o.unfused? std::string_view(norm) : src;
+        const bool stream = o.stream || lexSrc.size()>=kStreamLexThreshold;
+        Lexer L(lexSrc,/*longForm*/!o.unfused,stream? kStreamLexWindow:0);
+        Parser P(L); Module mod=P.parseModule();
+        ModuleBuild B(mod,o.ctSteps,o.optLevel); const Code& code=B.code;
 
-        if(run){
-            VM vm(E.code.bytes,(int)T.locals.size());
-            auto ret=vm.run_all();
+        if(o.run && o.regVM){
+            RegCode rc=to_register_ir(code);
+            RegVM vm(rc); auto ret=vm.run_all();
+            if(!label.empty()) std::cout<<label<<": ";
             std::cout<<ret<<"\n";
             return 0;
         }
-        if(emit){
-            std::cout<<"; PARASHADE v0.3 HEX IR ("<<E.code.bytes.size()<<" bytes)\n";
-            std::cout<<hex_dump(E.code.bytes)<<"\n\n; METADATA\n"<<meta_json(mod,T,E);
+        if(o.run){
+            VM vm(code);
+            auto ret=o.profilePairs? vm.run_profiled() : vm.run_all();
+            if(o.profilePairs) print_pair_profile(vm.pairs,label);
+            if(!label.empty()) std::cout<<label<<": ";
+            std::cout<<ret<<"\n";
             return 0;
         }
-        if(emit_nasm){
-            emit_nasm_pe(E.code,(int)T.locals.size(),outdir);
+        if(o.emit){
+            if(!label.empty()) std::cout<<"; "<<label<<"\n";
+            std::cout<<"; PARASHADE v0.3 HEX IR ("<<code.bytes.size()<<" bytes)\n";
+            std::cout<<hex_dump(code.bytes)<<"\n";
+            if(!code.consts.empty()){
+                std::cout<<"\n; CONST POOL ("<<code.consts.size()<<" entries)\n";
+                for(size_t k=0;k<code.consts.size();++k) std::cout<<k<<": 0x"<<std::hex<<code.consts[k]<<std::dec<<"\n";
+            }
+            if(o.regVM){
+                RegCode rc=to_register_ir(code); size_t regs=0;
+                for(auto& f:rc.funcs) regs=std::max(regs,f.init.size());
+                std::cout<<"\n; REGISTER IR ("<<rc.code.size()<<" instrs, "<<regs<<" registers max)\n"<<reg_listing(rc);
+            }
+            std::cout<<"\n; METADATA\n"<<meta_json(mod,B);
+            return 0;
+        }
+        if(o.emit_nasm){
+            emit_nasm_pe(code,outdir);
             std::cout<<"Wrote "<<outdir<<"/parashade_main.asm and build.bat\n";
             return 0;
         }
-        std::cerr<<"Usage: --run | --emit | --emit-nasm <outdir>\n";
+        std::cerr<<"Usage: --run | --emit | --emit-nasm <outdir>  [file.psd ...]  (stdin if no files)\n";
         return 1;
     } catch(const std::exception& e){
-        std::cerr<<"Compile/Run error: "<<e.what()<<"\n";
+        std::cerr<<(label.empty()? "":label+": ")<<"Compile/Run error: "<<e.what()<<"\n";
+        return 2;
+    }
+}
+
+// --run on a .parx artifact: the stack VM only (no IR for --vm=reg); VM
+// construction verifies the bytecode, which is what rejects a bad file.
+static int run_parx(std::string_view data, const DriverOptions& o, const string& label){
+    try{
+        if(o.regVM) throw std::runtime_error("--vm=reg needs source, not .parx");
+        Code code=read_parx(data);
+        VM vm(code);
+        auto ret=o.profilePairs? vm.run_profiled() : vm.run_all();
+        if(o.profilePairs) print_pair_profile(vm.pairs,label);
+        if(!label.empty()) std::cout<<label<<": ";
+        std::cout<<ret<<"\n";
+        return 0;
+    } catch(const std::exception& e){
+        std::cerr<<(label.empty()? "":label+": ")<<"Run error: "<<e.what()<<"\n";
         return 2;
     }
 }
+
+// --bench-vm: stack-VM time per run of the module's entry scope, portable
+// switch loop vs threaded dispatch (same bytecode, a fresh VM per run). The
+// loops alternate and each reports its best run, which keeps a noisy machine
+// from favouring whichever happened to run in a quiet stretch.
+static int bench_vm(std::string_view src, const DriverOptions& o, int reps){
+    using clk=std::chrono::steady_clock;
+    // same front end as compile_one, so --unfused/--stream apply here too
+    string norm; if(o.unfused) norm=normalize_longform(src);
+    const std::string_view lexSrc = o.unfused? std::string_view(norm) : src;
+    const bool stream = o.stream || lexSrc.size()>=kStreamLexThreshold;
+    Lexer L(lexSrc,/*longForm*/!o.unfused,stream? kStreamLexWindow:0);
+    Parser P(L); Module mod=P.parseModule();
+    ModuleBuild B(mod,o.ctSteps,o.optLevel);
+    VM probe(B.code); const int64_t want=probe.run_profiled();
+    uint64_t ops=0; for(auto n:probe.pairs) ops+=n;
+    auto time_one=[&](int64_t (VM::*run)(),double& best){
+        VM vm(B.code); auto t0=clk::now();
+        if((vm.*run)()!=want) throw std::runtime_error("bench: dispatch loops disagree");
+        best=std::min(best,std::chrono::duration<double>(clk::now()-t0).count());
+    };
+    double ts=1e30, tt=1e30;
+    for(int i=0;i<std::max(reps,1);i++){
+        time_one(&VM::run<false,false>,ts);
+#if PARASHADE_THREADED
+        time_one(&VM::run<false,true>,tt);
+#endif
+    }
+    std::cout<<std::fixed<<std::setprecision(3)
+             <<"vm: "<<ops<<" dispatches per run, best of "<<reps<<" (result "<<want<<")\n"
+             <<"  switch  : "<<ts*1e3<<" ms/run  "<<std::setprecision(1)<<ops/ts/1e6<<" M dispatch/s\n";
+#if PARASHADE_THREADED
+    std::cout<<std::setprecision(3)<<"  threaded: "<<tt*1e3<<" ms/run  "<<std::setprecision(1)<<ops/tt/1e6<<" M dispatch/s\n"
+             <<std::setprecision(2)<<"  speedup : "<<ts/tt<<"x\n";
+#else
+    (void)tt;
+    std::cout<<"  threaded: not available in this build (no labels-as-values)\n";
+#endif
+    return 0;
+}
+
+// ----------------- Build mode (--build -j N)
+// Fixed set of workers, each with its own deque of module indices: a worker
+// pops from the back of its own deque and, once that is empty, steals from the
+// front of the others'. Tasks never spawn tasks, so a fruitless sweep means done.
+struct WorkStealingPool{
+    struct Queue{ std::mutex m; std::deque<size_t> q; };
+    std::vector<Queue> qs;
+    explicit WorkStealingPool(unsigned n):qs(n? n:1){}
+    unsigned size() const { return (unsigned)qs.size(); }
+    bool next(unsigned w, size_t& t){
+        for(unsigned k=0;k<size();++k){
+            auto& Q=qs[(w+k)%size()]; std::lock_guard<std::mutex> g(Q.m);
+            if(Q.q.empty()) continue;
+            if(k==0){ t=Q.q.back(); Q.q.pop_back(); } else { t=Q.q.front(); Q.q.pop_front(); }
+            return true;
+        }
+        return false;
+    }
+    void run(size_t tasks, const std::function<void(unsigned,size_t)>& fn){
+        for(size_t t=0;t<tasks;++t) qs[t%size()].q.push_back(t);
+        std::vector<std::thread> ths;
+        for(unsigned w=0;w<size();++w) ths.emplace_back([&,w]{ size_t t; while(next(w,t)) fn(w,t); });
+        for(auto& th:ths) th.join();
+    }
+};
+
+struct BuildResult{ int rc=0; uint64_t lines=0; string err; };
+
+static string path_stem(const string& f){
+    string stem=f.substr(f.find_last_of("/\\")+1);
+    return stem.substr(0,stem.rfind('.'));
+}
+static void make_dir(const string& d){
+#ifdef _WIN32
+    CreateDirectoryA(d.c_str(),nullptr);
+#else
+    mkdir(d.c_str(),0777);
+#endif
+}
+
+// Compile one module to <outBase>.parx + <outBase>.meta.json. `arena` is the
+// worker's AST storage, handed back after use so its capacity carries over.
+static void build_one(const string& path, const string& outBase, const DriverOptions& o, Ast& arena, BuildResult& r){
+    try{
+        MappedFile mf(path); std::string_view src=mf.view();
+        r.lines=(uint64_t)std::count(src.begin(),src.end(),'\n')+(!src.empty() && src.back()!='\n');
+        string norm; if(o.unfused) norm=normalize_longform(src);
+        const std::string_view lexSrc = o.unfused? std::string_view(norm) : src;
+        const bool stream = o.stream || lexSrc.size()>=kStreamLexThreshold;
+        Lexer L(lexSrc,/*longForm*/!o.unfused,stream? kStreamLexWindow:0);
+        Parser P(L,std::move(arena)); Module mod=P.parseModule();
+        {
+            ModuleBuild B(mod,o.ctSteps,o.optLevel);
+            write_parx(outBase+".parx",B.code);
+            const string metaPath=outBase+".meta.json";
+            std::ofstream meta(metaPath,std::ios::binary); meta<<meta_json(mod,B);
+            if(!meta) throw std::runtime_error("cannot write '"+metaPath+"'");
+        }
+        arena=std::move(mod.ast);
+    } catch(const std::exception& e){
+        r.rc=2; r.err=e.what();
+    }
+}
+
+static int build_all(const std::vector<string>& files, const DriverOptions& o, unsigned jobs){
+    make_dir(o.outdir);
+    // artifact names: <stem>, or the first free <stem>.<n> when the name is
+    // taken; checked against every name handed out, since x.1.psd has the
+    // stem a second x.psd would get
+    std::vector<string> outBase(files.size());
+    std::unordered_set<string> taken;
+    for(size_t i=0;i<files.size();++i){
+        const string stem=path_stem(files[i]); string name=stem;
+        for(int n=1; !taken.insert(name).second; ++n) name=stem+"."+std::to_string(n);
+        outBase[i]=o.outdir+"/"+name;
+    }
+    std::vector<BuildResult> res(files.size());
+    WorkStealingPool pool(std::min<size_t>(jobs? jobs:1, std::max<size_t>(files.size(),1)));
+    std::vector<Ast> arenas(pool.size());
+    auto t0=std::chrono::steady_clock::now();
+    pool.run(files.size(),[&](unsigned w,size_t i){ build_one(files[i],outBase[i],o,arenas[w],res[i]); });
+    double secs=std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+
+    int rc=0; uint64_t lines=0; size_t failed=0;
+    for(size_t i=0;i<files.size();++i){
+        lines+=res[i].lines; rc=std::max(rc,res[i].rc);
+        if(res[i].rc){ ++failed; std::cerr<<files[i]<<": Compile error: "<<res[i].err<<"\n"; }
+    }
+    std::cout<<"built "<<files.size()-failed<<"/"<<files.size()<<" modules into "<<o.outdir
+             <<" (-j "<<pool.size()<<"): "<<lines<<" lines in "<<std::fixed<<std::setprecision(3)<<secs<<"s, "
+             <<std::setprecision(0)<<(secs>0? lines/secs:0)<<" lines/s\n";
+    return rc;
+}
+
+int main(int argc, char** argv){
+    std::ios::sync_with_stdio(false); std::cin.tie(nullptr);
+
+    DriverOptions o; bool bench_norm=false, bench_scn=false, bench_v=false; int benchReps=20;
+    unsigned jobs=std::max(1u,std::thread::hardware_concurrency());
+    std::vector<string> files;
+    for(int i=1;i<argc;i++){
+        string a=argv[i];
+        if(a=="--run") o.run=true;
+        else if(a=="--bench-normalize"){ bench_norm=true; if(i+1<argc && std::isdigit((unsigned char)argv[i+1][0])) benchReps=std::atoi(argv[++i]); }
+        else if(a=="--bench-scan"){ bench_scn=true; if(i+1<argc && std::isdigit((unsigned char)argv[i+1][0])) benchReps=std::atoi(argv[++i]); }
+        else if(a=="--bench-vm"){ bench_v=true; if(i+1<argc && std::isdigit((unsigned char)argv[i+1][0])) benchReps=std::atoi(argv[++i]); }
+        else if(a=="--emit") o.emit=true;
+        else if(a=="--unfused") o.unfused=true;
+        else if(a=="--stream") o.stream=true;
+        else if(a=="-O0"||a=="-O1"||a=="-O2") o.optLevel=a[2]-'0';
+        else if(a=="--profile-pairs") o.profilePairs=true;
+        else if(a=="--vm=reg"||a=="--vm=stack") o.regVM=(a=="--vm=reg");
+        else if(a=="--ct-steps"){ if(i+1<argc) o.ctSteps=std::strtoull(argv[++i],nullptr,10); }
+        else if(a=="--emit-nasm"){ o.emit_nasm=true; if(i+1<argc) o.outdir=argv[++i]; }
+        else if(a=="--build") o.build=true;
+        else if(a.rfind("-j",0)==0){ string n=a.size()>2? a.substr(2) : (i+1<argc? argv[++i] : ""); jobs=(unsigned)std::max(1,std::atoi(n.c_str())); }
+        else if(a=="-o"){ if(i+1<argc) o.outdir=argv[++i]; }
+        else if(a.size()>1 && a[0]=='-'){ std::cerr<<"unknown option "<<a<<"\n"; return 1; }
+        else files.push_back(a);
+    }
+
+    if(o.build){
+        if(files.empty()){ std::cerr<<"--build needs input files\n"; return 1; }
+        return build_all(files,o,jobs);
+    }
+    if(files.empty()){
+        string src((std::istreambuf_iterator<char>(std::cin)), {});
+        if(bench_norm) return bench_normalize(src,benchReps);
+        if(bench_scn) return bench_scan(src,benchReps);
+        if(bench_v){ try{ return bench_vm(src,o,benchReps); } catch(const std::exception& e){ std::cerr<<e.what()<<"\n"; return 2; } }
+        return compile_one(src,o,o.outdir,"");
+    }
+    int rc=0;
+    for(auto& f:files){
+        try{
+            MappedFile mf(f);
+            if(bench_v){ if(files.size()>1) std::cout<<"; "<<f<<"\n"; rc=std::max(rc,bench_vm(mf.view(),o,benchReps)); continue; }
+            if(bench_norm||bench_scn){ string src(mf.view()); rc=std::max(rc, bench_norm? bench_normalize(src,benchReps) : bench_scan(src,benchReps)); continue; }
+            // one module per file; several files get labelled output and an outdir each for NASM
+            const bool many=files.size()>1;
+            string outdir=o.outdir;
+            if(many && o.emit_nasm) outdir+="/"+path_stem(f);
+            if(o.run && f.size()>5 && f.compare(f.size()-5,5,".parx")==0){ rc=std::max(rc,run_parx(mf.view(),o,many? f:"")); continue; }
+            rc=std::max(rc,compile_one(mf.view(),o,outdir,many? f:""));
+        } catch(const std::exception& e){
+            std::cerr<<e.what()<<"\n"; rc=std::max(rc,2);
+        }
+    }
+    return rc;
+}